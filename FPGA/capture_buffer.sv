@@ -0,0 +1,154 @@
+// Capture of the audio streams for the HPS, read through h2f_window.
+// Each frame pairs a sample of the codec input with the sample last
+// written to the DAC, so that the HPS can record both in sync and
+// measure the latency of a loopback. Frames are kept in a ring of
+// 2^ADDR_WIDTH frames in two planes:
+//   input plane:  {left[23:8], right[23:8]} of the ADC.
+//   output plane: wave_out, sign extended.
+// Frames are counted modulo 2^16. The HPS writes back how many it has
+// read, which gives the fill level for the high-water mark. Frames are
+// written even when the ring is full, overwriting the oldest ones, and
+// the overrun flag is then set until the next write back.
+// HPS/AudioCapture.cpp is the reader.
+
+module capture_buffer #(
+	parameter ADDR_WIDTH = 10,
+	parameter HIGH_WATER = 512
+) (
+	input clk, rst,
+
+	// Audio streams
+	input adc_valid,
+	input [23:0] adc_l, adc_r,
+	input dac_wr_en,
+	input [23:0] dac_data,
+
+	// Read port: plane and frame, data valid the next cycle
+	input [ADDR_WIDTH:0] rd_addr,
+	output [31:0] rd_data,
+
+	// Frames read by the HPS, and status
+	input ack_en,
+	input [15:0] ack_count,
+	output [31:0] status
+);
+	localparam [16:0] FRAMES = 17'(2 ** ADDR_WIDTH);
+
+	logic [31:0] input_mem[0:2**ADDR_WIDTH-1], output_mem[0:2**ADDR_WIDTH-1];
+	logic [31:0] input_q, output_q;
+	logic plane_q;
+	assign rd_data = plane_q ? output_q : input_q;
+
+	// Counters and status: {high water, overrun, 14'd0, frames written}.
+	logic [15:0] wr_count, rd_count, level;
+	logic [23:0] dac_last;
+	logic overrun;
+	assign level = wr_count - rd_count;
+	assign status = {level >= 16'(HIGH_WATER), overrun, 14'd0, wr_count};
+
+	always_ff @(posedge clk) begin
+		if (adc_valid) begin
+			input_mem[wr_count[ADDR_WIDTH-1:0]] <= {adc_l[23:8], adc_r[23:8]};
+			output_mem[wr_count[ADDR_WIDTH-1:0]] <= {{8{dac_last[23]}}, dac_last};
+		end
+		input_q <= input_mem[rd_addr[ADDR_WIDTH-1:0]];
+		output_q <= output_mem[rd_addr[ADDR_WIDTH-1:0]];
+		plane_q <= rd_addr[ADDR_WIDTH];
+	end
+
+	always_ff @(posedge clk)
+		if (rst) begin
+			wr_count <= 16'd0;
+			rd_count <= 16'd0;
+			dac_last <= 24'd0;
+			overrun <= 1'b0;
+		end else begin
+			if (dac_wr_en)
+				dac_last <= dac_data;
+			if (ack_en) begin
+				rd_count <= ack_count;
+				overrun <= 1'b0;
+			end
+			if (adc_valid) begin
+				wr_count <= wr_count + 16'd1;
+				if ({1'b0, level} >= FRAMES)
+					overrun <= 1'b1;
+			end
+		end
+endmodule
+
+// synthesis translate_off
+
+module capture_buffer_testbench ();
+	logic clk, rst, adc_valid, dac_wr_en, ack_en;
+	logic [23:0] adc_l, adc_r, dac_data;
+	logic [4:0] rd_addr;
+	logic [31:0] rd_data, status;
+	logic [15:0] ack_count;
+	capture_buffer #(.ADDR_WIDTH(4), .HIGH_WATER(8)) dut (.*);
+
+	// Clock
+	initial clk = 1'b0;
+	always begin #10; clk <= ~clk; end
+
+	task push_frame(input int i);
+		dac_data = 24'(i * 3 - 20);
+		dac_wr_en = 1'b1;
+		@(negedge clk);
+		dac_wr_en = 1'b0;
+		adc_l = 24'(i * 256 + 12);
+		adc_r = 24'(-i * 256);
+		adc_valid = 1'b1;
+		@(negedge clk);
+		adc_valid = 1'b0;
+	endtask
+
+	// Testing
+	initial begin
+		rst = 1'b1;
+		adc_valid = 1'b0;
+		dac_wr_en = 1'b0;
+		ack_en = 1'b0;
+		rd_addr = 5'd0;
+		@(negedge clk);
+		rst = 1'b0;
+
+		// Fill up to the high-water mark.
+		for (int i = 0; i < 8; ++i) begin
+			assert (status == 32'(i));
+			push_frame(i);
+		end
+		assert (status == {1'b1, 15'd0, 16'd8});
+
+		// Both planes of each frame, on consecutive cycles.
+		for (int i = 0; i < 8; ++i) begin
+			rd_addr = {1'b0, 4'(i)};
+			@(negedge clk);
+			assert (rd_data == {16'(i), 16'(-i)});
+			rd_addr = {1'b1, 4'(i)};
+			@(negedge clk);
+			assert (rd_data == 32'(i * 3 - 20));
+		end
+		ack_count = 16'd8;
+		ack_en = 1'b1;
+		@(negedge clk);
+		ack_en = 1'b0;
+		assert (status == 32'd8);
+
+		// Overwrite a frame that has not been read.
+		for (int i = 8; i < 25; ++i)
+			push_frame(i);
+		assert (status == {2'b11, 14'd0, 16'd25});
+		rd_addr = {1'b0, 4'd8};
+		@(negedge clk);
+		assert (rd_data == {16'd24, 16'(-24)});
+		ack_count = 16'd25;
+		ack_en = 1'b1;
+		@(negedge clk);
+		ack_en = 1'b0;
+		assert (status == 32'd25);
+		$stop;
+	end
+endmodule
+
+// synthesis translate_on
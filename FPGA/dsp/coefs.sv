@@ -0,0 +1,10 @@
+// Coefficients of filters with fixed parameters, generated from
+// HPS/Tables.h. Each set is what the filter would compute from its
+// cutoff and resonance with the shared multiplier and divider.
+
+package coefs;
+	// lowpass_2 of square_delay: cutoff 425 Hz, resonance 0.5.
+	localparam [63:0] SQUARE_DELAY_LPF_C1 = 64'h0000003000083f2b;
+	localparam [63:0] SQUARE_DELAY_LPF_C2 = 64'hffff0ddb526a0f2b;
+	localparam [63:0] SQUARE_DELAY_LPF_C3 = 64'h0000e5096f0df69d;
+endpackage
@@ -2,11 +2,17 @@
 // Cutoff is unsigned and has exponent of -8.
 // Resonance is unsigned and has exponent of -16.
 // x and y are signed and have exponent of -24.
+// With FIXED set, the cutoff and resonance are ignored, and the
+// coefficients are given by FIXED_C1 to FIXED_C3, as generated in coefs.sv. The
+// filter then skips straight to the biquad, without the divider.
 // Author: Yibo Cao
 
 `timescale 1ns/1ns
 
-module lowpass_2 (
+module lowpass_2 #(
+	parameter FIXED = 0,
+	parameter [63:0] FIXED_C1 = 64'd0, FIXED_C2 = 64'd0, FIXED_C3 = 64'd0
+) (
 	// Control flow
 	input clk, rst, start,
 	output logic finish,
@@ -45,8 +51,15 @@ module lowpass_2 (
 			state <= IDLE;
 		else case (state)
 			IDLE:
-				if (start)
-					state <= BUBBLE_1;
+				if (start) begin
+					if (FIXED) begin
+						c1 <= FIXED_C1;
+						c2 <= FIXED_C2;
+						c3 <= FIXED_C3;
+						state <= BIQUAD;
+					end else
+						state <= BUBBLE_1;
+				end
 			BUBBLE_1:
 				state <= RADIAN;
 			RADIAN:
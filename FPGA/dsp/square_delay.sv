@@ -55,7 +55,9 @@ module square_delay (
 	
 	logic lpf_start, lpf_finish;
 	logic [31:0] lpf_mult_a, lpf_mult_b, lpf_out;
-	lowpass_2 m2 (.*, .start(lpf_start), .finish(lpf_finish),
+	lowpass_2 #(.FIXED(1), .FIXED_C1(coefs::SQUARE_DELAY_LPF_C1),
+		.FIXED_C2(coefs::SQUARE_DELAY_LPF_C2), .FIXED_C3(coefs::SQUARE_DELAY_LPF_C3))
+	m2 (.*, .start(lpf_start), .finish(lpf_finish),
 		.x({{8{wave_low[23]}}, wave_low}), .y(lpf_out), .resonance(32768),
 		.cutoff(24'(425 * 256)), .mult_a(lpf_mult_a), .mult_b(lpf_mult_b));
 
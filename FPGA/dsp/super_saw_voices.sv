@@ -0,0 +1,387 @@
+// Time-multiplexed polyphony for the super saw, with VOICES voices.
+// The voice table is kept in registers, so that key events apply in the
+// cycle they arrive. The oscillator phases and the amplitude of each
+// voice are kept in block RAM, and all voices run through one datapath
+// in turn, 62 cycles each, see synthesizers for the budget of a sample.
+// A press takes a free voice, the one released longest ago, or else
+// steals the voice pressed longest ago.
+// Voices only output positive values, and the mix saturates at the
+// largest positive value, as synthesizers mixes it as signed. The mix
+// then goes through the echo of delay.
+// HPS/VoiceEngine.cpp is the reference model. synthesizers still uses
+// super_saw_poly, until the testbench below matches the model, see
+// make super_saw_voices_test.
+
+`timescale 1ns/1ns
+
+module super_saw_voices #(
+	parameter VOICES = 8
+) (
+	// Control flow
+	input clk, rst, start,
+	output logic finish,
+
+	// Shared multiplier
+	input [63:0] mult_p,
+	output logic [31:0] mult_a, mult_b,
+
+	// Data
+	input key_press, key_release,
+	input [5:0] pitch,
+	input [23:0] freq,
+	output [23:0] wave_out
+);
+	localparam VOICE_BITS = VOICES > 1 ? $clog2(VOICES) : 1;
+	localparam [VOICE_BITS+2:0] LAST_SLOT = VOICES * 8 - 1;
+
+	// Initial phase of each sawtooth.
+	logic [23:0] phase_init[0:6];
+	assign phase_init[0] = 24'd11237;
+	assign phase_init[1] = 24'd9182;
+	assign phase_init[2] = 24'd28532;
+	assign phase_init[3] = 24'd13285;
+	assign phase_init[4] = 24'd18604;
+	assign phase_init[5] = 24'd33356;
+	assign phase_init[6] = 24'd321;
+
+	// Detuning of each sawtooth (-16).
+	logic [23:0] detuning[0:6];
+	assign detuning[0] = 24'd64596;
+	assign detuning[1] = 24'd64896;
+	assign detuning[2] = 24'd65347;
+	assign detuning[3] = 24'd65536;
+	assign detuning[4] = 24'd65764;
+	assign detuning[5] = 24'd66221;
+	assign detuning[6] = 24'd66451;
+
+	// Mixing of each sawtooth (-24).
+	logic [23:0] mixing[0:6];
+	assign mixing[0] = 24'd199729;
+	assign mixing[1] = 24'd249661;
+	assign mixing[2] = 24'd349525;
+	assign mixing[3] = 24'd499322;
+	assign mixing[4] = 24'd349525;
+	assign mixing[5] = 24'd249661;
+	assign mixing[6] = 24'd199729;
+
+	// Voice table. Stamps are the event count at the last press or
+	// release, so that the oldest voice has the largest age.
+	logic [5:0] voice_pitch[0:VOICES-1];
+	logic [23:0] voice_freq[0:VOICES-1], voice_freq_reg[0:VOICES-1];
+	logic voice_gate[0:VOICES-1], voice_gate_reg[0:VOICES-1],
+		voice_trigger[0:VOICES-1], voice_trigger_reg[0:VOICES-1];
+	logic [15:0] voice_stamp[0:VOICES-1], events;
+
+	// Voice taken by a press.
+	logic [VOICE_BITS-1:0] alloc;
+	logic [16:0] alloc_key, best_key;
+	always_comb begin
+		alloc = '0;
+		best_key = 17'd0;
+		for (int i = 0; i < VOICES; ++i) begin
+			alloc_key = {~voice_gate[i], events - voice_stamp[i]};
+			if (i == 0 || alloc_key > best_key) begin
+				alloc = VOICE_BITS'(i);
+				best_key = alloc_key;
+			end
+		end
+	end
+
+	// Voice state: the phases of the sawtooths at slots 0 to 6 of each
+	// voice, and the amplitude at slot 7.
+	logic [23:0] state_mem[0:VOICES*8-1];
+	logic [VOICE_BITS+2:0] rd_addr, wr_addr;
+	logic [23:0] rd_data, wr_data;
+	logic wr_en;
+	always_ff @(posedge clk) begin
+		if (wr_en)
+			state_mem[wr_addr] <= wr_data;
+		rd_data <= state_mem[rd_addr];
+	end
+
+	// Datapath of the current voice.
+	logic [VOICE_BITS-1:0] voice;
+	logic [VOICE_BITS+2:0] init_ctr;
+	logic [2:0] counter;
+	logic [23:0] amp, amp_next, voice_wave;
+	logic [VOICE_BITS+23:0] mixed;
+	logic [23:0] mix_sat;
+	assign mix_sat = mixed[VOICE_BITS+23:23] ? 24'h7FFFFF : mixed[23:0];
+	logic [24:0] phase_next;
+	logic [15:0] phase[0:6];
+	always_comb begin
+		if (voice_trigger_reg[voice])
+			amp_next = 24'd16777215;
+		else if (voice_gate_reg[voice])
+			amp_next = rd_data - ((rd_data - 24'd8388608) >> 11);
+		else
+			amp_next = rd_data - (rd_data >> 12);
+
+		// phase_integrator.
+		phase_next = {1'b0, rd_data} + mult_p[39:16];
+		if (phase_next > 25'(48000 * 256))
+			phase_next = phase_next - 25'(48000 * 256);
+	end
+
+	// Oscillator
+	logic saw_start, saw_finish;
+	logic [31:0] saw_mult_a, saw_mult_b;
+	logic [23:0] saw_wave;
+	saw m1 (.*, .start(saw_start), .finish(saw_finish),
+		.x(phase[counter]), .y(saw_wave),
+		.mult_a(saw_mult_a), .mult_b(saw_mult_b));
+
+	// Echo
+	logic delay_start, delay_finish;
+	logic [31:0] delay_mult_a, delay_mult_b;
+	delay m2 (.*, .start(delay_start), .finish(delay_finish),
+		.in(mix_sat), .out(wave_out),
+		.mult_a(delay_mult_a), .mult_b(delay_mult_b));
+
+	enum logic [3:0] {
+		INIT, IDLE, LOAD, ENV, S_1, DETUNE, SAW, S_2, MIX,
+		S_3, S_4, AMP, DELAY
+	} state;
+	always_ff @(posedge clk) begin
+		if (rst) begin
+			for (int i = 0; i < VOICES; ++i) begin
+				voice_pitch[i] <= 6'd0;
+				voice_freq[i] <= 24'd0;
+				voice_gate[i] <= 1'b0;
+				voice_trigger[i] <= 1'b0;
+				voice_stamp[i] <= 16'd0;
+			end
+			events <= 16'd0;
+			voice <= '0;
+			init_ctr <= '0;
+			state <= INIT;
+		end else begin
+			case (state)
+				INIT:
+					begin
+						if (init_ctr == LAST_SLOT)
+							state <= IDLE;
+						init_ctr <= init_ctr + 1'b1;
+					end
+				IDLE:
+					if (start) begin
+						mixed <= '0;
+						voice_freq_reg <= voice_freq;
+						voice_gate_reg <= voice_gate;
+						voice_trigger_reg <= voice_trigger;
+						for (int i = 0; i < VOICES; ++i)
+							voice_trigger[i] <= 1'b0;
+						voice <= '0;
+						state <= LOAD;
+					end
+				LOAD:
+					begin
+						voice_wave <= 24'd0;
+						state <= ENV;
+					end
+				ENV:
+					begin
+						amp <= amp_next;
+						state <= S_1;
+					end
+				S_1:
+					begin
+						counter <= 3'd0;
+						state <= DETUNE;
+					end
+				DETUNE:
+					begin
+						phase[counter] <= phase_next[23:8];
+						if (counter == 3'd6) begin
+							counter <= 3'd0;
+							state <= SAW;
+						end else
+							counter <= counter + 3'd1;
+					end
+				SAW:
+					if (saw_finish)
+						state <= S_2;
+				S_2:
+					state <= MIX;
+				MIX:
+					begin
+						voice_wave <= voice_wave + mult_p[47:24];
+						if (counter == 3'd6)
+							state <= S_3;
+						else
+							state <= SAW;
+						counter <= counter + 3'd1;
+					end
+				S_3:
+					state <= S_4;
+				S_4:
+					state <= AMP;
+				AMP:
+					begin
+						mixed <= mixed + mult_p[47:24];
+						if (voice == VOICE_BITS'(VOICES - 1))
+							state <= DELAY;
+						else begin
+							voice <= voice + 1'b1;
+							state <= LOAD;
+						end
+					end
+				DELAY:
+					if (delay_finish)
+						state <= IDLE;
+			endcase
+
+			// Handle key presses/releases.
+			if (key_press) begin
+				voice_pitch[alloc] <= pitch;
+				voice_freq[alloc] <= freq;
+				voice_gate[alloc] <= 1'b1;
+				voice_trigger[alloc] <= 1'b1;
+				voice_stamp[alloc] <= events;
+				events <= events + 16'd1;
+			end else if (key_release) begin
+				for (int i = 0; i < VOICES; ++i)
+					if (voice_gate[i] && voice_pitch[i] == pitch) begin
+						voice_gate[i] <= 1'b0;
+						voice_stamp[i] <= events;
+					end
+				events <= events + 16'd1;
+			end
+		end
+	end
+
+	always_comb begin
+		mult_a = 32'bX;
+		mult_b = 32'bX;
+		rd_addr = {voice, 3'd7};
+		wr_en = 1'b0;
+		wr_addr = 'X;
+		wr_data = 24'bX;
+		saw_start = 1'b0;
+		delay_start = 1'b0;
+		finish = 1'b0;
+
+		case (state)
+			INIT:
+				begin
+					wr_en = 1'b1;
+					wr_addr = init_ctr;
+					wr_data = init_ctr[2:0] == 3'd7 ? 24'd0 : phase_init[init_ctr[2:0]];
+				end
+			ENV:
+				begin
+					wr_en = 1'b1;
+					wr_addr = {voice, 3'd7};
+					wr_data = amp_next;
+					mult_a = voice_freq_reg[voice];
+					mult_b = detuning[0];
+				end
+			S_1:
+				begin
+					rd_addr = {voice, 3'd0};
+					mult_a = voice_freq_reg[voice];
+					mult_b = detuning[1];
+				end
+			DETUNE:
+				begin
+					rd_addr = {voice, counter + 3'd1};
+					wr_en = 1'b1;
+					wr_addr = {voice, counter};
+					wr_data = phase_next[23:0];
+					mult_a = voice_freq_reg[voice];
+					mult_b = detuning[counter + 3'd2];
+				end
+			SAW:
+				if (saw_finish) begin
+					mult_a = saw_wave;
+					mult_b = mixing[counter];
+				end else begin
+					saw_start = 1'b1;
+					mult_a = saw_mult_a;
+					mult_b = saw_mult_b;
+				end
+			S_3:
+				begin
+					mult_a = voice_wave;
+					mult_b = amp;
+				end
+			DELAY:
+				begin
+					delay_start = 1'b1;
+					mult_a = delay_mult_a;
+					mult_b = delay_mult_b;
+					finish = delay_finish;
+				end
+		endcase
+	end
+endmodule
+
+// synthesis translate_off
+
+// Checks the voice engine against the C++ reference model in
+// HPS/VoiceEngine.cpp, built with VOICE_ENGINE_DPI defined. Key events
+// on 16 pitches keep about twice as many notes held as there are voices.
+module super_saw_voices_testbench ();
+	import "DPI-C" function void voice_engine_reset(input int voices);
+	import "DPI-C" function int voice_engine_press(input int pitch, input int freq);
+	import "DPI-C" function void voice_engine_release(input int pitch);
+	import "DPI-C" function int voice_engine_sample();
+
+	localparam VOICES = 8;
+	logic clk, rst, start, finish, key_press, key_release;
+	logic [63:0] mult_p;
+	logic [31:0] mult_a, mult_b;
+	logic [5:0] pitch;
+	logic [23:0] freq, wave_out;
+	logic held[0:15];
+
+	shared_mult m1 (.*, .a(mult_a), .b(mult_b), .p(mult_p));
+	super_saw_voices #(.VOICES(VOICES)) dut (.*);
+
+	// Clock
+	initial clk = 1'b0;
+	always begin #10; clk <= ~clk; end
+
+	initial begin
+		rst = 1'b1;
+		start = 1'b0;
+		key_press = 1'b0;
+		key_release = 1'b0;
+		for (int i = 0; i < 16; ++i)
+			held[i] = 1'b0;
+		voice_engine_reset(VOICES);
+		@(negedge clk);
+		rst = 1'b0;
+
+		for (int i = 0; i < 48000; ++i) begin
+			if ($urandom_range(0, 31) == 0) begin
+				int p;
+				p = $urandom_range(0, 15);
+				pitch = 6'(p);
+				freq = 24'($urandom_range(30000, 510000));
+				if (held[p]) begin
+					key_release = 1'b1;
+					voice_engine_release(p);
+				end else begin
+					key_press = 1'b1;
+					void'(voice_engine_press(p, freq));
+				end
+				held[p] = ~held[p];
+				@(negedge clk);
+				key_press = 1'b0;
+				key_release = 1'b0;
+			end
+
+			start = 1'b1;
+			while (!finish)
+				@(negedge clk);
+			assert (wave_out == 24'(voice_engine_sample()))
+			else $error("sample %0d: %h", i, wave_out);
+			start = 1'b0;
+			@(negedge clk);
+		end
+		$stop;
+	end
+endmodule
+
+// synthesis translate_on
@@ -1,4 +1,4 @@
-// Frequency to pitch lookup table.
+// Frequency to pitch lookup table, generated from HPS/Tables.h.
 // This can be inferred as ROM.
 // Author: Yibo Cao
 
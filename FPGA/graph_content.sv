@@ -7,20 +7,27 @@ module graph_content (
 	input [2:0] drum_key,
 	input [5:0] track,
 	input [5:0] tile_ctr, tile_offset,
+	input wr_en,
 	input [23:0] wr_data,
 	input [11:0] wr_addr,
+	input note_mode,
+	input [23:0] note_rd_data,
 	output logic out_active,
 	output logic out_bdr_bottom,
 	output logic out_bdr_top,
 	output logic out_bdr_side,
 	output logic [2:0] out_inst
 );
-	logic [23:0] data[0:49*64-1], rd_data;
+	logic [23:0] data[0:49*64-1], tile_rd_data, rd_data;
 	logic [11:0] rd_addr;
+
+	// Tiles are written through the memory-mapped window.
 	always_ff @(posedge clk) begin
-		data[wr_addr] <= wr_data;
-		rd_data <= data[rd_addr];
+		if (wr_en)
+			data[wr_addr] <= wr_data;
+		tile_rd_data <= data[rd_addr];
 	end
+	assign rd_data = note_mode ? note_rd_data : tile_rd_data;
 	
 	always_comb begin
 		rd_addr = (tile_ctr + tile_offset & 63) * 49 + (is_drum ? 48 : track);
@@ -8,8 +8,14 @@ module graph_main (
 	input [5:0] key_status_wr_addr,
 	input [7:0] key_status_wr_data,
 	input [5:0] content_tile_offset,
+	input content_wr_en,
 	input [23:0] content_wr_data,
 	input [11:0] content_wr_addr,
+	input note_mode,
+	input [15:0] note_view_pos,
+	input note_wr_range_en, note_wr_attr_en,
+	input [7:0] note_wr_addr,
+	input [31:0] note_wr_data,
 	output logic [23:0] color
 );
 	// Height of each type of track.
@@ -57,7 +63,7 @@ module graph_main (
 	logic at_cursor, key_active, tile_active;
 	logic tile_bdr_bottom, tile_bdr_top, tile_bdr_side;
 	logic [2:0] key_inst, tile_inst;
-	logic [23:0] key_active_clr, tile_active_clr;
+	logic [23:0] key_active_clr, tile_active_clr, note_rd_data;
 	enum logic [2:0] {
 		S_OCTAVE,    // The octave indicator below keys.
 		S_SEPARATOR, // Separator between tracks.
@@ -74,12 +80,15 @@ module graph_main (
 	graph_colors m3 (.inst(key_inst), .color(key_active_clr));
 	graph_content m4 (.*, .drum_key(key[2:0]),
 		.tile_offset(content_tile_offset),
-		.wr_addr(content_wr_addr), .wr_data(content_wr_data),
+		.wr_en(content_wr_en), .wr_addr(content_wr_addr), .wr_data(content_wr_data),
 		.out_active(tile_active), .out_inst(tile_inst),
 		.out_bdr_bottom(tile_bdr_bottom),
 		.out_bdr_top(tile_bdr_top),
 		.out_bdr_side(tile_bdr_side));
 	graph_colors m5 (.inst(tile_inst), .color(tile_active_clr));
+	graph_notes m6 (.*, .view_pos(note_view_pos),
+		.wr_range_en(note_wr_range_en), .wr_attr_en(note_wr_attr_en),
+		.wr_addr(note_wr_addr), .wr_data(note_wr_data), .rd_data(note_rd_data));
 	
 	// Combinational logic
 	always_comb begin
@@ -94,7 +103,8 @@ module graph_main (
 		
 		is_drum = octave == 3'd4;
 		hei_now = is_drum ? HEI_DRUM : is_black ? HEI_BLACK : HEI_WHITE;
-		scrolled_tile_ctr = tile_ctr + grid_scroll;
+		// In note mode, the view position also scrolls the grid.
+		scrolled_tile_ctr = tile_ctr + (note_mode ? note_view_pos[3:0] : grid_scroll);
 		at_cursor = abs_ctr - (LEN_WHITE + LEN_TILE * 10'd8 - 1'b1) < 2'd3;
 		
 		case (state)
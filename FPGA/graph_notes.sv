@@ -0,0 +1,190 @@
+// This module renders the content display from a list of notes,
+// as an alternative to the tile memory written by the HPS.
+// While a track is displayed, the tile states of the next track are
+// rasterized into one of two line buffers by scanning the note list.
+// Positions are in 16th notes, view_pos is the position of tile 0.
+
+module graph_notes (
+	input clk, rst, new_frame,
+	input [5:0] track,
+	input [5:0] tile_ctr,
+	input [15:0] view_pos,
+
+	// Note list write port.
+	// Range entry: {end[15:0], start[15:0]}.
+	// Attribute entry: {valid, inst[2:0], pitch[5:0]}.
+	input wr_range_en, wr_attr_en,
+	input [7:0] wr_addr,
+	input [31:0] wr_data,
+
+	// Tile states of the current track, with the same latency and
+	// layout as the tile memory in graph_content.
+	output logic [23:0] rd_data
+);
+	// Note list.
+	logic [31:0] ranges[0:255], range_q;
+	logic [9:0] attrs[0:255], attr_q;
+	logic [7:0] scan_addr;
+	always_ff @(posedge clk) begin
+		if (wr_range_en) ranges[wr_addr] <= wr_data;
+		if (wr_attr_en) attrs[wr_addr] <= wr_data[9:0];
+		range_q <= ranges[scan_addr];
+		attr_q <= attrs[scan_addr];
+	end
+
+	// Line buffers, selected by the parity of the pitch.
+	logic [23:0] lines[0:1][0:63];
+	always_ff @(posedge clk)
+		rd_data <= lines[track >= 6'd48 ? 1'b0 : track[0]][tile_ctr];
+
+	enum logic [1:0] { IDLE, CLEAR, SCAN, LAST } state;
+
+	// Build requests: tracks 0 and 1 at the start of each frame,
+	// then the next track whenever the track changes.
+	logic [5:0] prev_track, build_pitch, req_pitch;
+	logic req, req_chain, build_chain;
+	always_ff @(posedge clk) begin
+		prev_track <= track;
+		if (rst) begin
+			req <= 1'b0;
+		end else if (new_frame) begin
+			req <= 1'b1;
+			req_pitch <= 6'd0;
+			req_chain <= 1'b1;
+		end else if (track != prev_track & track != 6'd0 & track < 6'd48) begin
+			req <= 1'b1;
+			req_pitch <= track + 1'b1;
+			req_chain <= 1'b0;
+		end else if (state == IDLE)
+			req <= 1'b0;
+	end
+
+	// Relative position of the scanned note.
+	logic signed [15:0] rel_start, rel_end;
+	logic match;
+	always_comb begin
+		rel_start = range_q[15:0] - view_pos;
+		rel_end = range_q[31:16] - view_pos;
+		match = attr_q[9] & attr_q[5:0] == build_pitch;
+	end
+
+	// Rasterizer.
+	always_ff @(posedge clk)
+		if (rst)
+			state <= IDLE;
+		else case (state)
+			IDLE:
+				if (req) begin
+					build_pitch <= req_pitch;
+					build_chain <= req_chain;
+					state <= CLEAR;
+				end
+			CLEAR:
+				begin
+					for (int i = 0; i < 64; ++i)
+						lines[build_pitch[0]][i] <= 24'd0;
+					scan_addr <= 8'd0;
+					state <= SCAN;
+				end
+			SCAN, LAST:
+				begin
+					// Entry of the previous address is available.
+					if (scan_addr != 8'd0 | state == LAST) begin
+						if (match) for (int i = 0; i < 64; ++i)
+							if (rel_start <= $signed(16'(i)) & rel_end >= $signed(16'(i)))
+								lines[build_pitch[0]][i][attr_q[8:6] * 3 +: 3] <= {
+									rel_end == 16'(i), rel_start == 16'(i), 1'b1};
+					end
+					scan_addr <= scan_addr + 1'b1;
+					if (state == LAST)
+						if (build_chain) begin
+							build_pitch <= build_pitch + 1'b1;
+							build_chain <= 1'b0;
+							state <= CLEAR;
+						end else
+							state <= IDLE;
+					else if (scan_addr == 8'd255)
+						state <= LAST;
+				end
+		endcase
+endmodule
+
+// synthesis translate_off
+
+// Checks the rasterizer against the C++ reference model in
+// HPS/NoteRaster.cpp, built with NOTE_RASTER_DPI defined by make dpi.
+// make graph_notes_test in FPGA runs it under Verilator.
+module graph_notes_testbench ();
+	import "DPI-C" function void note_raster_reset();
+	import "DPI-C" function void note_raster_set(
+		input int slot, input int start, input int end_time,
+		input int pitch, input int inst, input int valid);
+	import "DPI-C" function int note_raster_tile(
+		input int view_pos, input int pitch, input int tile);
+
+	logic clk, rst, new_frame, wr_range_en, wr_attr_en;
+	logic [5:0] track, tile_ctr;
+	logic [15:0] view_pos;
+	logic [7:0] wr_addr;
+	logic [31:0] wr_data;
+	logic [23:0] rd_data;
+	graph_notes dut (.*);
+
+	// Clock
+	initial clk = 1'b0;
+	always begin #10; clk <= ~clk; end
+
+	initial begin
+		rst = 1'b1;
+		new_frame = 1'b0;
+		wr_range_en = 1'b0;
+		wr_attr_en = 1'b0;
+		track = 6'd0;
+		tile_ctr = 6'd0;
+		@(negedge clk);
+		rst = 1'b0;
+
+		for (int pass = 0; pass < 8; ++pass) begin
+			// Random note list, with pitches limited so tracks are busy.
+			note_raster_reset();
+			for (int i = 0; i < 256; ++i) begin
+				int start, len, pitch, inst, valid;
+				start = $urandom_range(0, 200);
+				len = $urandom_range(1, 40);
+				pitch = $urandom_range(0, 48);
+				inst = $urandom_range(0, 7);
+				valid = $urandom_range(0, 3) != 0;
+				note_raster_set(i, start, start + len - 1, pitch, inst, valid);
+				wr_addr = 8'(i);
+				wr_data = {16'(start + len - 1), 16'(start)};
+				wr_range_en = 1'b1;
+				@(negedge clk);
+				wr_range_en = 1'b0;
+				wr_data = {22'd0, 1'(valid), 3'(inst), 6'(pitch)};
+				wr_attr_en = 1'b1;
+				@(negedge clk);
+				wr_attr_en = 1'b0;
+			end
+			view_pos = 16'($urandom_range(0, 160)) - 16'd8;
+
+			// Walk through the tracks like graph_main does.
+			new_frame = 1'b1;
+			@(negedge clk);
+			new_frame = 1'b0;
+			for (int t = 0; t < 56; ++t) begin
+				track = 6'(t);
+				repeat (600) @(negedge clk);
+				for (int i = 0; i < 64; ++i) begin
+					tile_ctr = 6'(i);
+					@(negedge clk);
+					assert (rd_data == 24'(note_raster_tile(
+						view_pos, t >= 48 ? 48 : t, i)))
+					else $error("track %0d tile %0d: %h", t, i, rd_data);
+				end
+			end
+		end
+		$stop;
+	end
+endmodule
+
+// synthesis translate_on
@@ -0,0 +1,234 @@
+// Memory-mapped window on the HPS lightweight bridge.
+// Writes are decoded into the tile memory of the content display,
+// so that a range of tiles can be written in one burst instead of
+// going through the address/data PIO registers. Reads return the
+// audio capture ring and its status, and zero elsewhere.
+// Word address map:
+//   0x0000 - 0x0C3F: tile states, same layout as in graph_content.
+//   0x1000 - 0x10FF: note list ranges, see graph_notes.
+//   0x1100 - 0x11FF: note list attributes, see graph_notes.
+//   0x1400 - 0x17FF: audio capture input plane (read), see capture_buffer.
+//   0x1800 - 0x1BFF: audio capture output plane (read).
+//   0x1F00:          display mode, bit 0 selects the note list.
+//   0x1F01:          view position of the note list.
+//   0x1F02:          pushes a timestamped key event, see synthesizers.
+//                    Reads bit 0 set if one was dropped since the last flush.
+//   0x1F03:          flushes the pending key events.
+//   0x1F04:          audio capture status (read).
+//   0x1F05:          frames of the audio capture read by the HPS.
+
+module h2f_window (
+	input clk, rst,
+
+	// Avalon-MM slave (byte addresses)
+	input [14:0] address,
+	input [3:0] byteenable,
+	input read, write,
+	input [31:0] writedata,
+	output logic [31:0] readdata,
+	output logic readdatavalid,
+	output waitrequest,
+
+	// Tile memory write port
+	output logic tile_wr_en,
+	output logic [11:0] tile_wr_addr,
+	output logic [23:0] tile_wr_data,
+
+	// Note list write port and registers
+	output logic note_wr_range_en, note_wr_attr_en,
+	output logic [7:0] note_wr_addr,
+	output logic [31:0] note_wr_data,
+	output logic note_mode,
+	output logic [15:0] note_view_pos,
+
+	// Key event FIFO
+	output logic key_event_wr_en, key_event_flush,
+	output logic [27:0] key_event_wr_data,
+	input key_event_overflow,
+
+	// Audio capture
+	output [10:0] capture_rd_addr,
+	input [31:0] capture_rd_data, capture_status,
+	output logic capture_ack_en,
+	output logic [15:0] capture_ack_count
+);
+	logic [12:0] word_addr;
+	assign word_addr = address[14:2];
+	assign waitrequest = 1'b0;
+
+	// Reads take one cycle: the capture ring is addressed directly, and
+	// the data is selected when it comes out.
+	enum logic [1:0] {RD_ZERO, RD_CAPTURE, RD_STATUS, RD_EVENTS} rd_src;
+	logic [31:0] status_q;
+	logic overflow_q;
+	assign capture_rd_addr = {word_addr[11], word_addr[9:0]};
+	always_comb
+		case (rd_src)
+			RD_CAPTURE: readdata = capture_rd_data;
+			RD_STATUS:  readdata = status_q;
+			RD_EVENTS:  readdata = {31'd0, overflow_q};
+			default:    readdata = 32'd0;
+		endcase
+
+	always_ff @(posedge clk)
+		if (rst) begin
+			tile_wr_en <= 1'b0;
+			note_wr_range_en <= 1'b0;
+			note_wr_attr_en <= 1'b0;
+			note_mode <= 1'b0;
+			note_view_pos <= 16'd0;
+			key_event_wr_en <= 1'b0;
+			key_event_flush <= 1'b0;
+			capture_ack_en <= 1'b0;
+			rd_src <= RD_ZERO;
+			readdatavalid <= 1'b0;
+		end else begin
+			tile_wr_en <= write & word_addr < 13'(49 * 64);
+			tile_wr_addr <= word_addr[11:0];
+			tile_wr_data <= writedata[23:0];
+			note_wr_range_en <= write & word_addr[12:8] == 5'h10;
+			note_wr_attr_en <= write & word_addr[12:8] == 5'h11;
+			note_wr_addr <= word_addr[7:0];
+			note_wr_data <= writedata;
+			if (write & word_addr == 13'h1F00)
+				note_mode <= writedata[0];
+			if (write & word_addr == 13'h1F01)
+				note_view_pos <= writedata[15:0];
+			key_event_wr_en <= write & word_addr == 13'h1F02;
+			key_event_wr_data <= writedata[27:0];
+			key_event_flush <= write & word_addr == 13'h1F03;
+			capture_ack_en <= write & word_addr == 13'h1F05;
+			capture_ack_count <= writedata[15:0];
+			if (word_addr[12:10] == 3'b101 || word_addr[12:10] == 3'b110)
+				rd_src <= RD_CAPTURE;
+			else if (word_addr == 13'h1F04)
+				rd_src <= RD_STATUS;
+			else if (word_addr == 13'h1F02)
+				rd_src <= RD_EVENTS;
+			else
+				rd_src <= RD_ZERO;
+			status_q <= capture_status;
+			overflow_q <= key_event_overflow;
+			readdatavalid <= read;
+		end
+endmodule
+
+module h2f_window_testbench ();
+	logic clk, rst, read, write, readdatavalid, waitrequest;
+	logic [14:0] address;
+	logic [3:0] byteenable;
+	logic [31:0] writedata, readdata;
+	logic tile_wr_en;
+	logic [11:0] tile_wr_addr;
+	logic [23:0] tile_wr_data;
+	logic note_wr_range_en, note_wr_attr_en, note_mode;
+	logic [7:0] note_wr_addr;
+	logic [31:0] note_wr_data;
+	logic [15:0] note_view_pos;
+	logic key_event_wr_en, key_event_flush, key_event_overflow;
+	logic [27:0] key_event_wr_data;
+	logic [10:0] capture_rd_addr;
+	logic [31:0] capture_rd_data, capture_status;
+	logic capture_ack_en;
+	logic [15:0] capture_ack_count;
+	h2f_window dut (.*);
+	assign key_event_overflow = 1'b1;
+
+	// Capture ring returning its address, one cycle later.
+	always_ff @(posedge clk)
+		capture_rd_data <= {21'h1CA, capture_rd_addr};
+	assign capture_status = 32'h8000_1234;
+
+	// Clock
+	initial clk = 1'b0;
+	always begin #10; clk <= ~clk; end
+
+	// Testing
+	initial begin
+		rst = 1'b1;
+		read = 1'b0;
+		write = 1'b0;
+		byteenable = 4'hF;
+		@(negedge clk);
+		rst = 1'b0;
+
+		// Burst over a whole row of tiles, then past the end of the memory.
+		for (int i = 0; i < 49 * 2; ++i) begin
+			address = 15'((49 * 63 + i) * 4);
+			writedata = 32'(i * 12345);
+			write = 1'b1;
+			@(negedge clk);
+			assert (tile_wr_en == (i < 49));
+			if (i < 49) begin
+				assert (tile_wr_addr == 12'(49 * 63 + i));
+				assert (tile_wr_data == 24'(i * 12345));
+			end
+		end
+		write = 1'b0;
+		@(negedge clk);
+		assert (!tile_wr_en);
+
+		// Note list and registers.
+		address = 15'(16'h1105 * 4);
+		writedata = 32'h25A;
+		write = 1'b1;
+		@(negedge clk);
+		assert (note_wr_attr_en && !note_wr_range_en && !tile_wr_en);
+		assert (note_wr_addr == 8'h05 && note_wr_data == 32'h25A);
+		address = 15'(16'h1F01 * 4);
+		writedata = 32'hFFF8;
+		@(negedge clk);
+		address = 15'(16'h1F00 * 4);
+		writedata = 32'h1;
+		@(negedge clk);
+		write = 1'b0;
+		assert (!note_wr_attr_en && note_mode && note_view_pos == 16'hFFF8);
+
+		// Key events.
+		address = 15'(16'h1F02 * 4);
+		writedata = 32'hF123ABC;
+		write = 1'b1;
+		@(negedge clk);
+		assert (key_event_wr_en && !key_event_flush && key_event_wr_data == 28'hF123ABC);
+		address = 15'(16'h1F03 * 4);
+		@(negedge clk);
+		write = 1'b0;
+		assert (!key_event_wr_en && key_event_flush);
+		@(negedge clk);
+		assert (!key_event_flush);
+
+		// Reads of the capture ring and status, back to back.
+		read = 1'b1;
+		address = 15'(16'h1405 * 4);
+		@(negedge clk);
+		assert (readdatavalid && readdata == {21'h1CA, 11'h005});
+		address = 15'(16'h1BFF * 4);
+		@(negedge clk);
+		assert (readdatavalid && readdata == {21'h1CA, 11'h7FF});
+		address = 15'(16'h1F04 * 4);
+		@(negedge clk);
+		assert (readdatavalid && readdata == 32'h8000_1234);
+		address = 15'(16'h1F02 * 4);
+		@(negedge clk);
+		assert (readdatavalid && readdata == 32'd1);
+
+		// Reads return zero elsewhere.
+		address = 15'(16'h1C00 * 4);
+		@(negedge clk);
+		read = 1'b0;
+		assert (readdatavalid && readdata == 32'd0);
+		@(negedge clk);
+		assert (!readdatavalid);
+
+		// Frames read by the HPS.
+		address = 15'(16'h1F05 * 4);
+		writedata = 32'h12345;
+		write = 1'b1;
+		@(negedge clk);
+		write = 1'b0;
+		assert (capture_ack_en && capture_ack_count == 16'h2345);
+		@(negedge clk);
+		assert (!capture_ack_en);
+		$stop;
+	end
+endmodule
@@ -0,0 +1,158 @@
+// Verilator harness of the display chain, see graph_frame.sv. Loads each
+// display state written by run_sim -G golden displays into the tile and
+// key status memories, and takes the next whole frame off the VGA port
+// the way the DAC does: on the rising edges of VGA_CLK where VGA_BLANK_N
+// is high. Each frame must match FrameRenderer pixel for pixel, and its
+// FNV-1a checksum the golden file.
+// Usage: Vgraph_frame displays golden [ppm prefix]
+// With a prefix, the frames of the RTL are saved as prefix<i>.ppm.
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Vgraph_frame.h"
+#include "verilated.h"
+#include "FrameRenderer.h"
+
+namespace {
+  class Harness {
+    VerilatedContext context;
+    Vgraph_frame dut;
+    const DisplayState *display;
+    uint8_t keyAddr;
+
+  public:
+    Harness() :dut(&context), display(nullptr), keyAddr(0) {
+      dut.rst = 1;
+      dut.content_wr_en = 0;
+      for (int i = 0; i < 4; ++i)
+        tick();
+      dut.rst = 0;
+    }
+
+    // One clock cycle. The key status memory is written with one key a
+    // cycle, like synthesizers does.
+    void tick() {
+      if (display) {
+        dut.key_status_wr_addr = keyAddr;
+        dut.key_status_wr_data = display->keys[keyAddr];
+        keyAddr = keyAddr == 48 ? 0 : keyAddr + 1;
+      }
+      dut.clk = 0;
+      dut.eval();
+      dut.clk = 1;
+      dut.eval();
+    }
+
+    void load(const DisplayState &in) {
+      display = &in;
+      dut.subtile_scroll = in.subtileScroll;
+      dut.grid_scroll = in.gridScroll;
+      dut.active_octave = in.activeOctave;
+      dut.active_inst = in.activeInst;
+      dut.content_tile_offset = in.tileOffset;
+      dut.content_wr_en = 1;
+      for (uint16_t i = 0; i < 49 * 64; ++i) {
+        dut.content_wr_addr = i;
+        dut.content_wr_data = in.tiles[i] & 0xFFFFFF;
+        tick();
+      }
+      dut.content_wr_en = 0;
+    }
+
+    // Skips to the end of the frame being drawn and one more, so that
+    // the frame taken is drawn entirely from the loaded state.
+    void frame(uint8_t *out) {
+      for (int frames = 0; frames < 2; ) {
+        tick();
+        frames += dut.new_frame;
+      }
+      size_t pixels = 0;
+      bool vgaClk = dut.VGA_CLK;
+      while (pixels < FRAME_WIDTH * FRAME_HEIGHT) {
+        tick();
+        if (dut.VGA_CLK && !vgaClk && dut.VGA_BLANK_N) {
+          *out++ = dut.VGA_R;
+          *out++ = dut.VGA_G;
+          *out++ = dut.VGA_B;
+          ++pixels;
+        }
+        vgaClk = dut.VGA_CLK;
+        if (dut.new_frame && pixels < FRAME_WIDTH * FRAME_HEIGHT)
+          throw std::runtime_error("frame ended after " + std::to_string(pixels) + " pixels");
+      }
+    }
+  };
+
+  std::vector<uint64_t> readGolden(const std::string &path) {
+    std::ifstream file(path);
+    if (!file)
+      throw std::runtime_error("failed to open " + path);
+    std::vector<uint64_t> golden;
+    std::string line;
+    while (std::getline(file, line))
+      golden.push_back(std::stoull(line, nullptr, 16));
+    return golden;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " displays golden [ppm prefix]" << std::endl;
+    return 1;
+  }
+  try {
+    std::ifstream file(argv[1], std::ios::binary);
+    if (!file)
+      throw std::runtime_error(std::string("failed to open ") + argv[1]);
+    std::vector<uint64_t> golden = readGolden(argv[2]);
+
+    std::unique_ptr<DisplayState> display(new DisplayState);
+    std::vector<uint8_t> frame(FRAME_WIDTH * FRAME_HEIGHT * 3), expected(frame.size());
+    FrameRenderer renderer;
+    Harness harness;
+    bool passed = true;
+    size_t i = 0;
+    for (; file.read(reinterpret_cast<char*>(display.get()), sizeof(DisplayState)); ++i) {
+      if (i >= golden.size())
+        throw std::runtime_error(std::string(argv[2]) + ": too few checksums");
+      harness.load(*display);
+      harness.frame(frame.data());
+      if (argc > 3)
+        FrameRenderer::savePPM(argv[3] + std::to_string(i) + ".ppm", frame.data());
+
+      // FNV-1a, as in run_sim -G.
+      uint64_t sum = 0xCBF29CE484222325;
+      for (uint8_t j : frame)
+        sum = (sum ^ j) * 0x100000001B3;
+      if (sum != golden[i]) {
+        std::cout << "frame " << i << ": checksum " << std::hex << sum << ", expected "
+          << golden[i] << std::dec << std::endl;
+        passed = false;
+      }
+      renderer.render(*display, expected.data());
+      for (size_t j = 0; j < frame.size(); j += 3)
+        if (frame[j] != expected[j] || frame[j + 1] != expected[j + 1]
+            || frame[j + 2] != expected[j + 2]) {
+          std::cout << "frame " << i << ": first difference at x " << j / 3 % FRAME_WIDTH
+            << " y " << j / 3 / FRAME_WIDTH << std::endl;
+          passed = false;
+          break;
+        }
+    }
+    if (i != golden.size())
+      throw std::runtime_error(std::string(argv[1]) + ": " + std::to_string(i)
+        + " displays for " + std::to_string(golden.size()) + " checksums");
+    if (!passed)
+      return 1;
+    std::cout << i << " frames of the RTL match " << argv[2] << std::endl;
+  } catch (std::exception &e) {
+    std::cerr << "graph_frame: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
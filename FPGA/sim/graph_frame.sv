@@ -0,0 +1,25 @@
+// Display chain of top for sim/graph_frame.cpp: vga_driver and graph_main
+// connected as in top, in tile mode.
+
+module graph_frame (
+	input clk, rst,
+	input [3:0] subtile_scroll, grid_scroll,
+	input [2:0] active_octave, active_inst,
+	input [5:0] key_status_wr_addr,
+	input [7:0] key_status_wr_data,
+	input [5:0] content_tile_offset,
+	input content_wr_en,
+	input [23:0] content_wr_data,
+	input [11:0] content_wr_addr,
+	output new_frame,
+	output [7:0] VGA_R, VGA_G, VGA_B,
+	output VGA_CLK, VGA_BLANK_N
+);
+	logic new_col, new_row;
+	logic [23:0] color;
+	logic VGA_HS, VGA_VS, VGA_SYNC_N;
+	vga_driver m1 (.*);
+	graph_main m2 (.*, .note_mode(1'b0), .note_view_pos(16'd0),
+		.note_wr_range_en(1'b0), .note_wr_attr_en(1'b0),
+		.note_wr_addr(8'd0), .note_wr_data(32'd0));
+endmodule
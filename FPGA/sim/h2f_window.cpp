@@ -0,0 +1,191 @@
+// Verilator harness of h2f_window. Drives the Avalon slave at the word
+// offsets of HPS/H2F.h, as the lightweight bridge would, and checks what
+// comes out of the ports: every tile address of Layout, the note list,
+// the key events, and the reads of the capture ring and its status with
+// their one-cycle latency.
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include "Vh2f_window.h"
+#include "verilated.h"
+#include "H2F.h"
+
+namespace {
+  class Harness {
+    VerilatedContext context;
+    Vh2f_window dut;
+    std::mt19937 rng;
+
+  public:
+    Harness() :dut(&context), rng(1) {
+      dut.rst = 1;
+      dut.read = 0;
+      dut.write = 0;
+      dut.byteenable = 0xF;
+      dut.key_event_overflow = 0;
+      dut.capture_status = 0;
+      tick();
+      dut.rst = 0;
+    }
+
+    uint32_t random() { return rng(); }
+
+    // What the capture ring returns for a read address.
+    static uint32_t ringData(uint32_t addr) { return 0x1CAu << 11 | addr; }
+
+    // One clock cycle. The capture ring answers like capture_buffer, on
+    // the cycle after it's addressed.
+    void tick() {
+      dut.clk = 0;
+      dut.eval();
+      uint32_t data = ringData(dut.capture_rd_addr);
+      dut.clk = 1;
+      dut.eval();
+      dut.capture_rd_data = data;
+      dut.eval();
+    }
+
+    void check(bool ok, const std::string &what) {
+      if (!ok)
+        throw std::runtime_error(what);
+      if (dut.waitrequest)
+        throw std::runtime_error("waitrequest raised at " + what);
+    }
+
+    // A single-cycle write at a window word offset.
+    void write(uint16_t offset, uint32_t value) {
+      dut.address = offset * 4;
+      dut.writedata = value;
+      dut.write = 1;
+      tick();
+      dut.write = 0;
+    }
+
+    // A read at a window word offset, which must return its data on the
+    // next cycle and not on the one it's issued.
+    uint32_t read(uint16_t offset) {
+      dut.address = offset * 4;
+      dut.read = 1;
+      dut.eval();
+      check(!dut.readdatavalid, "early readdatavalid at " + std::to_string(offset));
+      tick();
+      dut.read = 0;
+      check(dut.readdatavalid, "no readdatavalid at " + std::to_string(offset));
+      uint32_t value = dut.readdata;
+      tick();
+      check(!dut.readdatavalid, "readdatavalid held at " + std::to_string(offset));
+      return value;
+    }
+
+    void tiles() {
+      for (uint16_t i = 0; i < Layout::TILES; ++i) {
+        uint32_t value = random();
+        write(i, value);
+        check(dut.tile_wr_en && dut.tile_wr_addr == i && dut.tile_wr_data == (value & 0xFFFFFF)
+          && !dut.note_wr_range_en && !dut.note_wr_attr_en, "tile " + std::to_string(i));
+      }
+      // Past the tile memory, up to the note list.
+      for (uint16_t i = Layout::TILES; i < H2F_NOTE_RANGES; i += 61) {
+        write(i, random());
+        check(!dut.tile_wr_en, "tile write past the memory at " + std::to_string(i));
+      }
+      tick();
+      check(!dut.tile_wr_en, "tile write held");
+    }
+
+    void notes() {
+      for (uint16_t slot = 0; slot < 256; ++slot) {
+        uint32_t range = random(), attr = random();
+        write(H2F_NOTE_RANGES + slot, range);
+        check(dut.note_wr_range_en && !dut.note_wr_attr_en && !dut.tile_wr_en
+          && dut.note_wr_addr == slot && dut.note_wr_data == range,
+          "note range " + std::to_string(slot));
+        write(H2F_NOTE_ATTRS + slot, attr);
+        check(dut.note_wr_attr_en && !dut.note_wr_range_en
+          && dut.note_wr_addr == slot && dut.note_wr_data == attr,
+          "note attributes " + std::to_string(slot));
+      }
+      write(H2F_NOTE_MODE, 1);
+      write(H2F_VIEW_POS, 0x1FFF8);
+      check(dut.note_mode && dut.note_view_pos == 0xFFF8 && !dut.note_wr_attr_en,
+        "note mode and view position");
+      write(H2F_NOTE_MODE, 0);
+      check(!dut.note_mode && dut.note_view_pos == 0xFFF8, "note mode off");
+      check(read(H2F_NOTE_MODE) == 0, "read of a write-only register");
+    }
+
+    void keyEvents() {
+      for (int i = 0; i < 16; ++i) {
+        uint32_t value = random();
+        write(H2F_KEY_EVENT, value);
+        check(dut.key_event_wr_en && !dut.key_event_flush
+          && dut.key_event_wr_data == (value & 0xFFFFFFF), "key event " + std::to_string(i));
+        tick();
+        check(!dut.key_event_wr_en, "key event held");
+      }
+      write(H2F_KEY_FLUSH, 1);
+      check(dut.key_event_flush && !dut.key_event_wr_en, "key event flush");
+      tick();
+      check(!dut.key_event_flush, "key event flush held");
+
+      // The overflow flag, as H2F::keyEventsDropped reads it.
+      for (int overflow = 0; overflow < 2; ++overflow) {
+        dut.key_event_overflow = overflow;
+        check(read(H2F_KEY_EVENT) == static_cast<uint32_t>(overflow), "key event overflow");
+      }
+      dut.key_event_overflow = 0;
+    }
+
+    void capture() {
+      // Both planes in the order of H2F::readCapture, one frame a read.
+      for (uint16_t plane = 0; plane < 2; ++plane)
+        for (uint16_t frame = 0; frame < H2F_CAPTURE_FRAMES; ++frame) {
+          uint16_t offset = (plane ? H2F_CAPTURE_OUTPUTS : H2F_CAPTURE_INPUTS) + frame;
+          check(read(offset) == ringData(plane << 10 | frame), "capture plane "
+            + std::to_string(plane) + " frame " + std::to_string(frame));
+        }
+
+      // Back to back, each read returning on the next cycle.
+      dut.read = 1;
+      for (uint16_t i = 0; i <= 3; ++i) {
+        dut.address = (H2F_CAPTURE_INPUTS + i) * 4;
+        tick();
+        check(dut.readdatavalid && dut.readdata == ringData(i),
+          "back to back capture read " + std::to_string(i));
+      }
+      dut.address = H2F_CAPTURE_STATUS * 4;
+      dut.capture_status = H2F_CAPTURE_HIGH_WATER | 0x1234;
+      tick();
+      dut.read = 0;
+      check(dut.readdatavalid && dut.readdata == (H2F_CAPTURE_HIGH_WATER | 0x1234),
+        "back to back status read");
+      tick();
+      check(!dut.readdatavalid, "readdatavalid after a burst");
+
+      dut.capture_status = H2F_CAPTURE_OVERRUN | 0xBEEF;
+      check(read(H2F_CAPTURE_STATUS) == (H2F_CAPTURE_OVERRUN | 0xBEEF), "capture status");
+      write(H2F_CAPTURE_ACK, 0x1ABCD);
+      check(dut.capture_ack_en && dut.capture_ack_count == 0xABCD, "capture ack");
+      tick();
+      check(!dut.capture_ack_en, "capture ack held");
+    }
+  };
+}
+
+int main(int argc, char *argv[]) {
+  Verilated::commandArgs(argc, argv);
+  try {
+    Harness harness;
+    harness.tiles();
+    harness.notes();
+    harness.keyEvents();
+    harness.capture();
+  } catch (std::exception &e) {
+    std::cerr << "h2f_window: " << e.what() << std::endl;
+    return 1;
+  }
+  std::cout << "h2f_window passed" << std::endl;
+  return 0;
+}
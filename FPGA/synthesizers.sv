@@ -4,8 +4,17 @@
 
 module synthesizers (
 	input clk, rst, next_sample,
+	input [13:0] sample_counter,
 	input [5:0] key_status_wr_addr,
 	input [7:0] key_status_wr_data,
+	// Timestamped key events: {pitch[5:0], insts[7:0], sample[13:0]}.
+	input key_event_wr_en, key_event_flush,
+	input [27:0] key_event_wr_data,
+	// Set once an event was dropped on a full FIFO, until the next flush.
+	output logic key_event_overflow,
+	// Combined key states, for the display.
+	output logic [5:0] key_display_addr,
+	output logic [7:0] key_display_data,
 	output logic [23:0] wave_out
 );
 	logic [31:0] mixed;
@@ -18,6 +27,56 @@ module synthesizers (
 	shared_mult m1 (.*, .a(mult_a), .b(mult_b), .p(mult_p));
 	shared_div m2 (.*, .n(div_n), .d(div_d), .q(div_q));
 
+	// Key events scheduled by the HPS. The FIFO keeps the last popped
+	// entry on its output, which is applied once the sample counter
+	// reaches its timestamp, so that events take effect on an exact sample.
+	// Events pushed while it's full are dropped rather than overwriting
+	// the oldest, so that the rest stay in time order, and the HPS resyncs.
+	logic event_ready, event_wr_ready, event_rd_en, event_valid, event_due;
+	logic [27:0] event_head;
+	logic [13:0] event_delta;
+	logic [6:0] clear_ctr;
+	fifo #(.DATA_WIDTH(28), .ADDR_WIDTH(8)) m4 (.clk, .rst(rst | key_event_flush),
+		.wr_en(key_event_wr_en & event_wr_ready), .wr_data(key_event_wr_data), .wr_ready(event_wr_ready),
+		.rd_en(event_rd_en), .rd_data(event_head), .rd_ready(event_ready));
+	assign event_rd_en = ~event_valid & event_ready;
+	assign event_delta = sample_counter - event_head[13:0];
+	assign event_due = event_valid & ~clear_ctr[6] & ~event_delta[13];
+	always_ff @(posedge clk)
+		if (rst | key_event_flush)
+			event_valid <= 1'b0;
+		else if (event_rd_en)
+			event_valid <= 1'b1;
+		else if (event_due)
+			event_valid <= 1'b0;
+	always_ff @(posedge clk)
+		if (rst | key_event_flush)
+			key_event_overflow <= 1'b0;
+		else if (key_event_wr_en & ~event_wr_ready)
+			key_event_overflow <= 1'b1;
+
+	// Key states are the union of the states written directly by the HPS
+	// and the scheduled states. Each cycle updates one pitch: a flush
+	// clears the scheduled states of all pitches, then due events are
+	// applied, otherwise the direct register is sampled.
+	logic [5:0] upd_pitch;
+	logic [7:0] upd_direct, upd_sched;
+	logic [7:0] direct_states[0:48], sched_states[0:48];
+	always_comb
+		if (clear_ctr[6]) begin
+			upd_pitch = clear_ctr[5:0];
+			upd_direct = direct_states[upd_pitch];
+			upd_sched = 8'd0;
+		end else if (event_due) begin
+			upd_pitch = event_head[27:22];
+			upd_direct = direct_states[upd_pitch];
+			upd_sched = event_head[21:14];
+		end else begin
+			upd_pitch = key_status_wr_addr;
+			upd_direct = key_status_wr_data;
+			upd_sched = sched_states[upd_pitch];
+		end
+
 	// Key press / release detection.
 	logic [5:0] pitch;
 	logic [23:0] freq;
@@ -27,13 +86,22 @@ module synthesizers (
 		if (rst) begin
 			old_insts <= 8'b0;
 			new_insts <= 8'b0;
+			clear_ctr <= 7'd0;
 		end else begin
-			pitch <= key_status_wr_addr;
-			old_insts <= key_states[key_status_wr_addr];
-			new_insts <= key_status_wr_data;
-			key_states[key_status_wr_addr] <= key_status_wr_data;
+			if (key_event_flush)
+				clear_ctr <= 7'd64;
+			else if (clear_ctr[6])
+				clear_ctr <= clear_ctr == 7'd64 + 7'd48 ? 7'd0 : clear_ctr + 1'b1;
+			pitch <= upd_pitch;
+			old_insts <= key_states[upd_pitch];
+			new_insts <= upd_direct | upd_sched;
+			key_states[upd_pitch] <= upd_direct | upd_sched;
+			direct_states[upd_pitch] <= upd_direct;
+			sched_states[upd_pitch] <= upd_sched;
 		end
-	freq_table m3 (.*, .pitch(key_status_wr_addr));
+	freq_table m3 (.*, .pitch(upd_pitch));
+	assign key_display_addr = pitch;
+	assign key_display_data = new_insts;
 	assign key_presses = new_insts & ~old_insts;
 	assign key_releases = old_insts & ~new_insts;
 	assign tonal_presses = (pitch == 6'd48) ? 8'b0 : key_presses;
@@ -93,7 +161,14 @@ module synthesizers (
 		.key_press(tonal_presses[3]), .key_release(tonal_releases[3]), .wave_out(squ_wave),
 		.mult_a(squ_mult_a), .mult_b(squ_mult_b), .div_n(squ_div_n), .div_d(squ_div_d));
 
-	// Main state machine.
+	// Main state machine. The synthesizers run one after another on the
+	// shared multiplier, and must finish within the 2041 cycles of a
+	// sample at 98 MHz. Cycles of each state, at most:
+	//   IDLE 1, KICK 19, SNARE to SNARE_MIX 61, HAT to HAT_MIX 16,
+	//   SAW 350 (4 voices of 87, the lowpass taking 77 with the divider),
+	//   SUPER 254 (4 voices of 62, and 6 for the delay),
+	//   BASS 88, SQU 182 (4 voices of 44, and 6 for the delay).
+	// That is 971 cycles. super_saw_voices would take 502 for 8 voices.
 	enum logic [3:0] {
 		IDLE, KICK,
 		SNARE, SNARE_BUBBLE, SNARE_MIX,
@@ -50,10 +50,15 @@ module top (
 	debounce i5[1:0] (.*, .in(sw_bouncy), .out(inputs[5:4]));
 	debounce i6[11:0] (.*, .in(keyboard_bouncy), .out(inputs[17:6]));
 
-	// HPS
+	// HPS. content_ctrl_2 is unused, as tiles are written through the
+	// memory-mapped window.
 	logic [31:0] view_ctrl, content_ctrl_1, content_ctrl_2;
 	logic [5:0] key_status_wr_addr;
 	logic [7:0] key_status_wr_data;
+	logic [14:0] window_address;
+	logic [3:0] window_byteenable;
+	logic window_read, window_write, window_readdatavalid, window_waitrequest;
+	logic [31:0] window_readdata, window_writedata;
 	hps i7 (
 		.clk_clk(clk), .rst_reset(rst),
 		.h2f_rst_reset_n(h2f_rst_n),
@@ -76,35 +81,79 @@ module top (
 		.view_ctrl_export(view_ctrl),
 		.content_ctrl_1_export(content_ctrl_1),
 		.content_ctrl_2_export(content_ctrl_2),
-		.inputs_export(inputs)
+		.inputs_export(inputs),
+		.window_address(window_address),
+		.window_byteenable(window_byteenable),
+		.window_read(window_read),
+		.window_write(window_write),
+		.window_writedata(window_writedata),
+		.window_readdata(window_readdata),
+		.window_readdatavalid(window_readdatavalid),
+		.window_waitrequest(window_waitrequest),
+		.window_burstcount(),
+		.window_debugaccess()
 	);
 	assign key_status_wr_addr = view_ctrl[19:14];
 	assign key_status_wr_data = view_ctrl[27:20];
 
+	// Memory-mapped window
+	logic tile_wr_en;
+	logic [11:0] tile_wr_addr;
+	logic [23:0] tile_wr_data;
+	logic note_wr_range_en, note_wr_attr_en, note_mode;
+	logic [7:0] note_wr_addr;
+	logic [31:0] note_wr_data;
+	logic [15:0] note_view_pos;
+	logic key_event_wr_en, key_event_flush, key_event_overflow;
+	logic [27:0] key_event_wr_data;
+	logic [10:0] capture_rd_addr;
+	logic [31:0] capture_rd_data, capture_status;
+	logic capture_ack_en;
+	logic [15:0] capture_ack_count;
+	h2f_window i8 (.*, .address(window_address), .byteenable(window_byteenable),
+		.read(window_read), .write(window_write), .writedata(window_writedata),
+		.readdata(window_readdata), .readdatavalid(window_readdatavalid),
+		.waitrequest(window_waitrequest));
+
 	// Video processing
 	logic new_col, new_row, new_frame;
 	logic [23:0] color;
+	logic [5:0] key_display_addr;
+	logic [7:0] key_display_data;
 	vga_driver m1 (.*);
 	graph_main m2 (.*,
 		.subtile_scroll(view_ctrl[3:0]), .grid_scroll(view_ctrl[7:4]),
 		.active_octave(view_ctrl[10:8]), .active_inst(view_ctrl[13:11]),
-		.content_tile_offset(content_ctrl_1[5:0]), .content_wr_addr(content_ctrl_1[17:6]),
-		.content_wr_data(content_ctrl_2[23:0]));
+		.content_tile_offset(content_ctrl_1[5:0]),
+		.content_wr_en(tile_wr_en), .content_wr_addr(tile_wr_addr),
+		.content_wr_data(tile_wr_data),
+		.key_status_wr_addr(key_display_addr), .key_status_wr_data(key_display_data));
 
 	// Audio processing
 	logic setup_done, rd_ready, wr_ready;
 	logic [23:0] wave_out;
+	logic [13:0] sample_counter;
 	synthesizers m3 (.*, .next_sample(wr_ready));
 	
 	// Use audio sample count as the time base used by HPS.
-	logic [13:0] sample_counter;
 	always_ff @(posedge clk)
 		if (wr_ready) sample_counter <= rst ? 0 : sample_counter + 1;
 	assign inputs[31:18] = sample_counter;
 	
 	// Audio driver
 	audio_init m5 (.*, .sda(FPGA_I2C_SDAT), .scl(FPGA_I2C_SCLK));
+	logic [23:0] adc_l, adc_r;
 	audio_buffer m6 (.*, .wr_en(wr_ready), .rd_en(rd_ready),
 		.wr_data_l(wave_out), .wr_data_r(wave_out),
-		.rd_data_l(), .rd_data_r());
+		.rd_data_l(adc_l), .rd_data_r(adc_r));
+
+	// Capture of the codec input and the synthesized output for the HPS.
+	// The ADC FIFO data comes out the cycle after it's read.
+	logic adc_valid;
+	always_ff @(posedge clk)
+		adc_valid <= ~rst & rd_ready;
+	capture_buffer m7 (.*, .dac_wr_en(wr_ready), .dac_data(wave_out),
+		.rd_addr(capture_rd_addr), .rd_data(capture_rd_data),
+		.ack_en(capture_ack_en), .ack_count(capture_ack_count),
+		.status(capture_status));
 endmodule
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+#include "AudioCapture.h"
+
+namespace {
+  const uint32_t SAMPLE_RATE = 48000;
+  const uint32_t HEADER_BYTES = 44;
+  // Output file: one 24-bit channel. Input file: two 16-bit channels.
+  const uint16_t CHANNELS = 1, SAMPLE_BYTES = 3;
+  const uint16_t INPUT_CHANNELS = 2, INPUT_SAMPLE_BYTES = 2;
+  const uint32_t FRAME_BYTES = CHANNELS * SAMPLE_BYTES;
+  const uint32_t INPUT_FRAME_BYTES = INPUT_CHANNELS * INPUT_SAMPLE_BYTES;
+
+  uint8_t *putLE(uint8_t *at, uint32_t value, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; ++i)
+      *at++ = value >> 8 * i;
+    return at;
+  }
+
+  void writeHeader(std::ofstream &file, uint16_t channels, uint16_t sampleBytes, uint64_t frames) {
+    uint8_t header[HEADER_BYTES];
+    uint32_t frameBytes = channels * sampleBytes;
+    uint32_t dataBytes = frames * frameBytes;
+    uint8_t *at = header;
+    at = std::copy_n("RIFF", 4, at);
+    at = putLE(at, HEADER_BYTES - 8 + dataBytes, 4);
+    at = std::copy_n("WAVEfmt ", 8, at);
+    at = putLE(at, 16, 4);
+    // PCM.
+    at = putLE(at, 1, 2);
+    at = putLE(at, channels, 2);
+    at = putLE(at, SAMPLE_RATE, 4);
+    at = putLE(at, SAMPLE_RATE * frameBytes, 4);
+    at = putLE(at, frameBytes, 2);
+    at = putLE(at, 8 * sampleBytes, 2);
+    at = std::copy_n("data", 4, at);
+    putLE(at, dataBytes, 4);
+    file.write(reinterpret_cast<const char*>(header), HEADER_BYTES);
+  }
+
+  // name.wav to name.input.wav.
+  std::string inputPathOf(const std::string &path) {
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || path.find('/', dot) != std::string::npos)
+      dot = path.size();
+    return path.substr(0, dot) + ".input" + path.substr(dot);
+  }
+
+  // Signed 16-bit halves of an input plane word.
+  int16_t inputLeft(uint32_t word) { return static_cast<int16_t>(word >> 16); }
+  int16_t inputRight(uint32_t word) { return static_cast<int16_t>(word); }
+}
+
+AudioCapture::AudioCapture(H2F &h2f, const std::string &path)
+    :h2f(h2f), path(path), inputPath(inputPathOf(path)), file(path, std::ios::binary),
+    inputFile(inputPath, std::ios::binary), slots(new Block[CAPTURE_SLOTS]),
+    head(0), tail(0), stopping(false), failed(false), lost(0), frames(0), lostTotal(0),
+    overruns(0), marked(false), markFrame(0), onsets(0), missed(0), totalLatency(0),
+    minLatency(UINT32_MAX), maxLatency(0), fileFrames(0),
+    buffer(CAPTURE_BLOCK * FRAME_BYTES), inputBuffer(CAPTURE_BLOCK * INPUT_FRAME_BYTES) {
+  if (!file)
+    throw std::runtime_error("failed to open " + path);
+  if (!inputFile)
+    throw std::runtime_error("failed to open " + inputPath);
+  writeHeaders();
+
+  // Start from the current frame.
+  lastWritten = readCount = h2f.getCaptureStatus();
+  h2f.ackCapture(readCount);
+  thread = std::thread(&AudioCapture::threadMain, this);
+}
+
+AudioCapture::~AudioCapture() {
+  finish();
+}
+
+void AudioCapture::finish() {
+  if (!thread.joinable())
+    return;
+  drain(true);
+  stopping.store(true, std::memory_order_release);
+  thread.join();
+}
+
+void AudioCapture::poll() {
+  drain(false);
+}
+
+void AudioCapture::drain(bool all) {
+  uint32_t status = h2f.getCaptureStatus();
+  uint16_t written = lastWritten = status;
+  uint16_t level = written - readCount;
+  bool acked = false;
+
+  // Until the ring reaches the high-water mark, a poll only reads the
+  // status, and the blocks are then copied in one burst.
+  if (!all && !(status & (H2F_CAPTURE_HIGH_WATER | H2F_CAPTURE_OVERRUN))
+      && level <= H2F_CAPTURE_FRAMES)
+    return;
+
+  // After an overrun, skip to what's still in the ring, leaving a block
+  // for the frames written meanwhile.
+  if (status & H2F_CAPTURE_OVERRUN || level > H2F_CAPTURE_FRAMES) {
+    ++overruns;
+    uint16_t keep = H2F_CAPTURE_FRAMES - CAPTURE_BLOCK;
+    if (level > keep) {
+      lost += level - keep;
+      readCount = written - keep;
+      level = keep;
+    }
+    acked = true;
+  }
+
+  while (level >= CAPTURE_BLOCK || (all && level)) {
+    uint16_t count = std::min<uint16_t>(level, CAPTURE_BLOCK);
+    uint32_t at = tail.load(std::memory_order_relaxed);
+    if (at - head.load(std::memory_order_acquire) == CAPTURE_SLOTS) {
+      // The writer is behind.
+      lost += count;
+    } else {
+      Block &block = slots[at % CAPTURE_SLOTS];
+      block.count = count;
+      h2f.readCapture(readCount, count, block.inputs, block.outputs);
+      detectOnset(block, readCount);
+      block.lost = lost;
+      lostTotal += lost;
+      lost = 0;
+      frames += count;
+      tail.store(at + 1, std::memory_order_release);
+    }
+    readCount += count;
+    level -= count;
+    acked = true;
+  }
+  if (acked)
+    h2f.ackCapture(readCount);
+}
+
+void AudioCapture::mark() {
+  markFrame = h2f.getCaptureStatus();
+  marked = true;
+}
+
+void AudioCapture::detectOnset(const Block &block, uint16_t first) {
+  for (uint16_t i = 0; marked && i < block.count; ++i) {
+    uint16_t since = first + i - markFrame;
+    // Frames from before the mark.
+    if (since & 0x8000)
+      continue;
+    if (since >= CAPTURE_ONSET_WINDOW) {
+      ++missed;
+      marked = false;
+    } else if (std::abs(inputLeft(block.inputs[i])) >= CAPTURE_ONSET
+        || std::abs(inputRight(block.inputs[i])) >= CAPTURE_ONSET) {
+      ++onsets;
+      totalLatency += since;
+      minLatency = std::min<uint32_t>(minLatency, since);
+      maxLatency = std::max<uint32_t>(maxLatency, since);
+      marked = false;
+    }
+  }
+}
+
+void AudioCapture::threadMain() {
+  for (;;) {
+    // Blocks pushed before stopping are seen after it.
+    bool stop = stopping.load(std::memory_order_acquire);
+    uint32_t at = head.load(std::memory_order_relaxed);
+    if (at == tail.load(std::memory_order_acquire)) {
+      if (stop)
+        break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      continue;
+    }
+    writeBlock(slots[at % CAPTURE_SLOTS]);
+    head.store(at + 1, std::memory_order_release);
+  }
+  // Fill in the sizes.
+  file.seekp(0);
+  inputFile.seekp(0);
+  writeHeaders();
+  file.close();
+  inputFile.close();
+  if (!file || !inputFile)
+    failed.store(true, std::memory_order_relaxed);
+}
+
+void AudioCapture::writeBlock(const Block &block) {
+  // Lost frames as silence.
+  std::fill(buffer.begin(), buffer.end(), 0);
+  std::fill(inputBuffer.begin(), inputBuffer.end(), 0);
+  for (uint32_t left = block.lost; left; ) {
+    uint32_t count = std::min<uint32_t>(left, CAPTURE_BLOCK);
+    file.write(reinterpret_cast<const char*>(buffer.data()), count * FRAME_BYTES);
+    inputFile.write(reinterpret_cast<const char*>(inputBuffer.data()), count * INPUT_FRAME_BYTES);
+    left -= count;
+  }
+
+  uint8_t *at = buffer.data(), *inputAt = inputBuffer.data();
+  for (uint16_t i = 0; i < block.count; ++i) {
+    at = putLE(at, block.outputs[i], SAMPLE_BYTES);
+    inputAt = putLE(inputAt, inputLeft(block.inputs[i]), INPUT_SAMPLE_BYTES);
+    inputAt = putLE(inputAt, inputRight(block.inputs[i]), INPUT_SAMPLE_BYTES);
+  }
+  file.write(reinterpret_cast<const char*>(buffer.data()), block.count * FRAME_BYTES);
+  inputFile.write(reinterpret_cast<const char*>(inputBuffer.data()), block.count * INPUT_FRAME_BYTES);
+  fileFrames += block.lost + block.count;
+  if (!file || !inputFile)
+    failed.store(true, std::memory_order_relaxed);
+}
+
+void AudioCapture::writeHeaders() {
+  writeHeader(file, CHANNELS, SAMPLE_BYTES, fileFrames);
+  writeHeader(inputFile, INPUT_CHANNELS, INPUT_SAMPLE_BYTES, fileFrames);
+}
+
+void AudioCapture::report(std::ostream &out) const {
+  out << "audio capture: " << frames << " frames to " << path << " and " << inputPath << ", "
+    << lostTotal + lost << " lost, " << overruns << " overruns";
+  if (failed.load(std::memory_order_relaxed))
+    out << ", write failed";
+  out << std::endl;
+  if (onsets || missed) {
+    out << "loopback latency: " << onsets << " onsets";
+    if (onsets)
+      out << ", mean " << static_cast<double>(totalLatency) / onsets << " min " << minLatency
+        << " max " << maxLatency << " samples";
+    out << ", " << missed << " missed" << std::endl;
+  }
+}
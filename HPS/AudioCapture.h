@@ -0,0 +1,85 @@
+#ifndef _AUDIO_CAPTURE_H_
+#define _AUDIO_CAPTURE_H_
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "H2F.h"
+
+// AudioCapture: records the audio capture ring of the FPGA, see
+//   capture_buffer.sv, into two WAV files of the same length at 48 kHz:
+//   the synthesized output as one 24-bit channel, and next to it, in
+//   name.input.wav, the left and the right codec input as two 16-bit
+//   channels, the bits the ring keeps of them. The real-time loop copies
+//   whole blocks out of the ring into preallocated slots, and a
+//   background thread converts them and writes the files, so that the
+//   loop never waits for the disk. Frames lost to an overrun are written
+//   as silence, to keep the files in time.
+//   Also measures the loopback latency: after a mark, the first input
+//   frame past CAPTURE_ONSET ends the measurement.
+
+#define CAPTURE_BLOCK 256
+#define CAPTURE_SLOTS 64
+// Input level of an onset, of the 16 bits captured.
+#define CAPTURE_ONSET 1024
+// Frames after a mark without an onset before it counts as missed.
+#define CAPTURE_ONSET_WINDOW 4800
+// Frames between the latency probes of Main.
+#define CAPTURE_PROBE_PERIOD 24000
+
+class AudioCapture {
+  struct Block {
+    uint16_t count;
+    // Frames lost right before the block.
+    uint32_t lost;
+    uint32_t inputs[CAPTURE_BLOCK], outputs[CAPTURE_BLOCK];
+  };
+  H2F &h2f;
+  std::string path, inputPath;
+  std::ofstream file, inputFile;
+
+  // Single producer, single consumer queue of blocks.
+  std::unique_ptr<Block[]> slots;
+  std::atomic<uint32_t> head, tail;
+  std::atomic<bool> stopping, failed;
+
+  // Only accessed by the real-time loop.
+  uint16_t readCount, lastWritten;
+  uint32_t lost;
+  uint64_t frames, lostTotal, overruns;
+  bool marked;
+  uint16_t markFrame;
+  uint64_t onsets, missed, totalLatency;
+  uint32_t minLatency, maxLatency;
+
+  // Only accessed by the writer thread.
+  uint64_t fileFrames;
+  std::vector<uint8_t> buffer, inputBuffer;
+
+  std::thread thread;
+  void threadMain();
+  // Copies the frames in the ring, down to partial blocks if all.
+  void drain(bool all);
+  void detectOnset(const Block &block, uint16_t first);
+  void writeBlock(const Block &block);
+  void writeHeaders();
+public:
+  AudioCapture(H2F &h2f, const std::string &path);
+  ~AudioCapture();
+  // Writes the rest of the ring and completes the files.
+  void finish();
+  // Copies the complete blocks in the ring once it's past the high-water
+  // mark. Never blocks.
+  void poll();
+  // Frames written by the FPGA at the last poll.
+  uint16_t getWritten() const { return lastWritten; }
+  // Starts a latency measurement from the current frame.
+  void mark();
+  void report(std::ostream &out) const;
+};
+
+#endif
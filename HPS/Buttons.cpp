@@ -6,7 +6,8 @@ Buttons::Buttons(Main &main)
   scrollCountN(), scrollCountP(),
   disableOctaveL(), disableOctaveR(),
   disableScrollN(), disableScrollP(),
-  disableInstN(), disableInstP() {}
+  disableInstN(), disableInstP(),
+  disableSong() {}
 
 bool Buttons::hasDelayEnded(uint8_t which) {
   return main.getTimeBase() - lastUnpressed[which] >= BUTTONS_DELAY;
@@ -36,6 +37,7 @@ void Buttons::update(uint8_t input) {
     disableInstN = true;
     disableOctaveL = true;
     disableScrollN = true;
+    disableSong = true;
     main.shiftInst(false);
   }
 
@@ -45,14 +47,28 @@ void Buttons::update(uint8_t input) {
     disableInstP = true;
     disableOctaveR = true;
     disableScrollP = true;
+    disableSong = true;
     main.shiftInst(true);
   }
 
+  // The outer buttons together switch songs.
+  if (!wasPressed[3] && !wasPressed[0])
+    disableSong = false;
+  else if (!disableSong && wasPressed[3] && wasPressed[0]) {
+    disableSong = true;
+    disableOctaveL = true;
+    disableOctaveR = true;
+    disableInstN = true;
+    disableInstP = true;
+    main.nextSong();
+  }
+
   if (!wasPressed[3])
     disableOctaveL = false;
   else if (!disableOctaveL && hasDelayEnded(3)) {
     disableOctaveL = true;
     disableInstN = true;
+    disableSong = true;
     main.shiftOctave(false);
   }
 
@@ -77,6 +93,7 @@ void Buttons::update(uint8_t input) {
   else if (!disableOctaveR && hasDelayEnded(0)) {
     disableOctaveR = true;
     disableInstP = true;
+    disableSong = true;
     main.shiftOctave(true);
   }
 }
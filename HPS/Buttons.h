@@ -17,6 +17,7 @@ class Buttons {
   bool disableOctaveL, disableOctaveR;
   bool disableScrollN, disableScrollP;
   bool disableInstN, disableInstP;
+  bool disableSong;
   bool hasDelayEnded(uint8_t which);
   bool checkScroll(uint8_t which, uint32_t &scrollCount);
 public:
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include "Capture.h"
+
+namespace {
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    // Records lost to the ring wrapping around.
+    uint64_t dropped;
+    uint64_t count;
+  };
+  const char CAPTURE_MAGIC[4] = {'F', 'M', 'C', 'P'};
+
+  uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  std::string describe(const Capture::Record &record) {
+    std::ostringstream out;
+    out << std::hex;
+    if (record.offset == Capture::CAPTURE_INPUT)
+      out << "input 0x" << record.value;
+    else
+      out << "write [0x" << record.offset << "] = 0x" << record.value;
+    return out.str();
+  }
+}
+
+Capture::Capture(uint8_t sizeLog2)
+    :replaying(false), records(static_cast<size_t>(1) << sizeLog2),
+    sample(0), count(0), dropped(0), pos(0), inputsLeft(0),
+    elapsedSamples(0), diverged(false), lastInputNs(0) {}
+
+Capture::Capture(const std::string &path)
+    :replaying(true), sample(0), count(0), dropped(0), pos(0), inputsLeft(0),
+    elapsedSamples(0), diverged(false), lastInputNs(0) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("failed to open " + path);
+  Header header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+      || memcmp(header.magic, CAPTURE_MAGIC, 4) || header.version != 1)
+    throw std::runtime_error(path + ": not a capture file");
+  // Check the count against the file before allocating for it.
+  std::streamoff start = file.tellg();
+  file.seekg(0, std::ios::end);
+  uint64_t available = (file.tellg() - start) / sizeof(Record);
+  file.seekg(start);
+  if (header.count > available)
+    throw std::runtime_error(path + ": truncated capture file, " + std::to_string(header.count)
+      + " records in the header, " + std::to_string(available) + " in the file");
+  records.resize(header.count);
+  if (!file.read(reinterpret_cast<char*>(records.data()), header.count * sizeof(Record)))
+    throw std::runtime_error(path + ": truncated capture file");
+  dropped = header.dropped;
+
+  bool first = true;
+  uint16_t prevSample = 0;
+  for (const Record &i : records) {
+    if (i.offset != CAPTURE_INPUT) continue;
+    ++inputsLeft;
+    if (!first)
+      elapsedSamples += (i.sample - prevSample) & 0x3FFF;
+    prevSample = i.sample;
+    first = false;
+  }
+  iterationNs.reserve(inputsLeft);
+}
+
+void Capture::onInput(uint32_t value) {
+  sample = value >> 18;
+  if (replaying) {
+    uint64_t now = nowNs();
+    if (lastInputNs)
+      iterationNs.push_back(now - lastInputNs);
+    lastInputNs = now;
+  } else {
+    Record &record = records[count++ & (records.size() - 1)];
+    record.sample = sample;
+    record.offset = CAPTURE_INPUT;
+    record.value = value;
+  }
+}
+
+void Capture::onWrite(uint32_t offset, uint32_t value) {
+  if (replaying) {
+    if (diverged) return;
+    if (pos < records.size() && records[pos].offset == offset
+        && records[pos].value == value)
+      ++pos;
+    else
+      diverge("got " + describe({sample, static_cast<uint16_t>(offset), value}));
+  } else {
+    Record &record = records[count++ & (records.size() - 1)];
+    record.sample = sample;
+    record.offset = offset;
+    record.value = value;
+  }
+}
+
+void Capture::diverge(const std::string &what) {
+  diverged = true;
+  std::ostringstream out;
+  out << "record " << pos << " (sample " << sample << "): expected ";
+  if (pos < records.size())
+    out << describe(records[pos]);
+  else
+    out << "end of capture";
+  out << ", " << what;
+  divergence = out.str();
+}
+
+uint32_t Capture::nextInput() {
+  // Writes left before the next input were not made.
+  while (records[pos].offset != CAPTURE_INPUT) {
+    if (!diverged)
+      diverge("got the next input");
+    ++pos;
+  }
+  --inputsLeft;
+  return records[pos++].value;
+}
+
+void Capture::save(const std::string &path) const {
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("failed to open " + path);
+  Header header;
+  memcpy(header.magic, CAPTURE_MAGIC, 4);
+  header.version = 1;
+  header.dropped = count > records.size() ? count - records.size() : 0;
+  header.count = count - header.dropped;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  // Oldest records first.
+  const char *data = reinterpret_cast<const char*>(records.data());
+  if (header.dropped) {
+    size_t start = count & (records.size() - 1);
+    file.write(data + start * sizeof(Record), (records.size() - start) * sizeof(Record));
+    file.write(data, start * sizeof(Record));
+  } else {
+    file.write(data, count * sizeof(Record));
+  }
+  if (!file)
+    throw std::runtime_error("failed to write " + path);
+}
+
+void Capture::report(std::ostream &out) {
+  if (dropped)
+    out << "warning: the first " << dropped
+      << " records were dropped, replay starts mid-session" << std::endl;
+  out << (diverged ? "diverged at " + divergence : "no divergence") << std::endl;
+
+  std::vector<uint32_t> sorted(iterationNs);
+  std::sort(sorted.begin(), sorted.end());
+  uint64_t total = 0;
+  for (uint32_t i : sorted)
+    total += i;
+  if (sorted.empty() || !total) return;
+  double seconds = total * 1e-9;
+  out << sorted.size() << " iterations in " << std::fixed << std::setprecision(3)
+    << seconds << " s, " << std::setprecision(0) << sorted.size() / seconds
+    << " iterations/s, " << std::setprecision(1)
+    << elapsedSamples / 48000.0 / seconds << "x real time" << std::endl;
+  out << "ns per iteration: mean " << total / sorted.size()
+    << ", p50 " << sorted[sorted.size() / 2]
+    << ", p99 " << sorted[sorted.size() * 99 / 100]
+    << ", max " << sorted.back() << std::endl;
+}
@@ -0,0 +1,58 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Capture: records the bridge traffic of a session, i.e. every input
+//   word read and every register written, into a preallocated ring.
+//   A saved capture can be replayed: the recorded inputs are fed back
+//   as fast as possible, and the writes are checked against the
+//   recorded ones. The program must be started with the same song
+//   arguments as the captured session.
+
+class Capture {
+public:
+  struct Record {
+    // Sample counter of the iteration, from the last input word.
+    uint16_t sample;
+    // Word offset of the write, or CAPTURE_INPUT.
+    uint16_t offset;
+    uint32_t value;
+  };
+  static const uint16_t CAPTURE_INPUT = 0xFFFF;
+
+private:
+  bool replaying;
+  std::vector<Record> records;
+  uint16_t sample;
+
+  // Recording: ring of a power of two size.
+  uint64_t count;
+
+  // Replay.
+  uint64_t dropped;
+  size_t pos, inputsLeft;
+  uint64_t elapsedSamples;
+  bool diverged;
+  std::string divergence;
+  std::vector<uint32_t> iterationNs;
+  uint64_t lastInputNs;
+  void diverge(const std::string &what);
+
+public:
+  // Starts recording, keeping the last 2^sizeLog2 records.
+  explicit Capture(uint8_t sizeLog2);
+  // Loads a capture for replay.
+  explicit Capture(const std::string &path);
+  bool isReplaying() const { return replaying; }
+  void onInput(uint32_t value);
+  void onWrite(uint32_t offset, uint32_t value);
+  void save(const std::string &path) const;
+  bool hasInputs() const { return !replaying || inputsLeft; }
+  uint32_t nextInput();
+  void report(std::ostream &out);
+};
+
+#endif
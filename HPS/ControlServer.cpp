@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "ControlServer.h"
+#include "Layout.h"
+
+namespace {
+  // Epoll data of the descriptors other than the clients.
+  const uint64_t LISTENER_ID = UINT64_MAX;
+  const uint64_t WAKE_ID = UINT64_MAX - 1;
+
+  const size_t MAX_BATCH_SIZE = sizeof(ControlHeader)
+    + CONTROL_MAX_COMMANDS * sizeof(ControlCommand);
+
+  sockaddr_un socketAddress(const std::string &path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+      throw std::runtime_error("socket path too long: " + path);
+    strcpy(address.sun_path, path.c_str());
+    return address;
+  }
+
+  // Index of the first command out of range, or the count.
+  uint32_t checkCommands(const std::vector<ControlCommand> &commands) {
+    for (uint32_t i = 0; i < commands.size(); ++i) {
+      const ControlCommand &command = commands[i];
+      switch (command.op) {
+        case ControlCommand::ADD_NOTE:
+        case ControlCommand::REMOVE_NOTE:
+          if (!command.b || command.pitch >= Layout::KEYS || command.inst >= Layout::INSTS)
+            return i;
+          break;
+        case ControlCommand::SET_OCTAVE:
+          if (command.a > Layout::DRUM_OCTAVE)
+            return i;
+          break;
+        case ControlCommand::SET_INST:
+          if (command.a >= Layout::INSTS)
+            return i;
+          break;
+        case ControlCommand::SEEK:
+        case ControlCommand::PLAY:
+        case ControlCommand::STOP:
+        case ControlCommand::QUERY:
+          break;
+        default:
+          return i;
+      }
+    }
+    return commands.size();
+  }
+}
+
+uint64_t controlClock() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+ControlServer::ControlServer(const std::string &path)
+    :path(path), listener(socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)),
+    poller(epoll_create1(EPOLL_CLOEXEC)), wakeRead(-1), wakeWrite(-1), stopping(false),
+    nextClient(0), buffer(MAX_BATCH_SIZE + 1), hasPending(false) {
+  if (listener.fd < 0)
+    throw std::runtime_error("failed to create socket");
+  if (poller.fd < 0)
+    throw std::runtime_error("failed to create epoll");
+
+  // Replace the socket of a previous run.
+  sockaddr_un address = socketAddress(path);
+  unlink(path.c_str());
+  if (bind(listener.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+      || listen(listener.fd, 8) < 0)
+    throw std::runtime_error("failed to listen on " + path);
+
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0)
+    throw std::runtime_error("failed to create pipe");
+  wakeRead.fd = fds[0];
+  wakeWrite.fd = fds[1];
+
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = LISTENER_ID;
+  if (epoll_ctl(poller.fd, EPOLL_CTL_ADD, listener.fd, &event) < 0)
+    throw std::runtime_error("failed to watch " + path);
+  event.data.u64 = WAKE_ID;
+  if (epoll_ctl(poller.fd, EPOLL_CTL_ADD, wakeRead.fd, &event) < 0)
+    throw std::runtime_error("failed to watch pipe");
+  thread = std::thread(&ControlServer::threadMain, this);
+}
+
+ControlServer::~ControlServer() {
+  stopping = true;
+  char dummy = 0;
+  if (write(wakeWrite.fd, &dummy, 1) == 1)
+    thread.join();
+  else
+    thread.detach();
+  for (auto &i : clients)
+    close(i.second);
+  unlink(path.c_str());
+}
+
+void ControlServer::threadMain() {
+  for (;;) {
+    epoll_event events[16];
+    int count = epoll_wait(poller.fd, events, 16, -1);
+    if (count < 0)
+      continue;
+    for (int i = 0; i < count; ++i) {
+      uint64_t id = events[i].data.u64;
+      if (id == WAKE_ID) {
+        char buffer[64];
+        while (read(wakeRead.fd, buffer, sizeof(buffer)) > 0) {}
+        if (stopping)
+          return;
+        sendReplies();
+      } else if (id == LISTENER_ID) {
+        accept();
+      } else {
+        auto client = clients.find(id);
+        if (client != clients.end())
+          receive(client->first, client->second);
+      }
+    }
+  }
+}
+
+void ControlServer::accept() {
+  int fd = accept4(listener.fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+  if (fd < 0)
+    return;
+  uint32_t id = nextClient++;
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = id;
+  if (epoll_ctl(poller.fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+    close(fd);
+    return;
+  }
+  clients[id] = fd;
+}
+
+void ControlServer::dropClient(uint32_t client) {
+  auto i = clients.find(client);
+  if (i == clients.end())
+    return;
+  epoll_ctl(poller.fd, EPOLL_CTL_DEL, i->second, nullptr);
+  close(i->second);
+  clients.erase(i);
+}
+
+void ControlServer::receive(uint32_t client, int fd) {
+  ssize_t size = recv(fd, buffer.data(), buffer.size(), 0);
+  if (size < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+  if (size <= 0) {
+    dropClient(client);
+    return;
+  }
+
+  ControlBatch batch;
+  batch.client = client;
+  batch.arrival = controlClock();
+  batch.reply = ControlReply();
+  ControlHeader header = {};
+  memcpy(&header, buffer.data(), std::min<size_t>(size, sizeof(header)));
+  batch.reply.batch = header.batch;
+  if (static_cast<size_t>(size) < sizeof(header) || header.magic != CONTROL_MAGIC
+      || header.count > CONTROL_MAX_COMMANDS
+      || static_cast<size_t>(size) != sizeof(header) + header.count * sizeof(ControlCommand)) {
+    batch.reply.status = ControlReply::BAD_BATCH;
+    send(client, batch.reply);
+    return;
+  }
+  batch.commands.resize(header.count);
+  memcpy(batch.commands.data(), buffer.data() + sizeof(header), header.count * sizeof(ControlCommand));
+  batch.reply.badCommand = checkCommands(batch.commands);
+  if (batch.reply.badCommand != header.count) {
+    // Batches apply whole or not at all.
+    batch.reply.status = ControlReply::BAD_COMMAND;
+    send(client, batch.reply);
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(mailLock);
+  pending.push_back(std::move(batch));
+  hasPending = true;
+}
+
+void ControlServer::sendReplies() {
+  std::vector<ControlBatch> batches;
+  {
+    std::lock_guard<std::mutex> guard(mailLock);
+    batches.swap(applied);
+  }
+  for (const ControlBatch &i : batches)
+    send(i.client, i.reply);
+}
+
+void ControlServer::send(uint32_t client, const ControlReply &reply) {
+  auto i = clients.find(client);
+  if (i == clients.end())
+    return;
+  // A client that doesn't read its replies loses them.
+  if (::send(i->second, &reply, sizeof(reply), MSG_DONTWAIT | MSG_NOSIGNAL) < 0
+      && errno != EAGAIN)
+    dropClient(client);
+}
+
+bool ControlServer::poll(std::vector<ControlBatch> &out) {
+  if (!hasPending.load(std::memory_order_relaxed))
+    return false;
+  std::unique_lock<std::mutex> guard(mailLock, std::try_to_lock);
+  if (!guard.owns_lock() || pending.empty())
+    return false;
+  out.swap(pending);
+  hasPending = false;
+  return true;
+}
+
+bool ControlServer::complete(std::vector<ControlBatch> &batches) {
+  {
+    std::unique_lock<std::mutex> guard(mailLock, std::try_to_lock);
+    if (!guard.owns_lock() || !applied.empty())
+      return false;
+    applied.swap(batches);
+  }
+  char dummy = 0;
+  if (write(wakeWrite.fd, &dummy, 1) != 1)
+    std::cout << "control: failed to wake the server" << std::endl;
+  return true;
+}
+
+ControlClient::ControlClient(const std::string &path)
+    :fd(socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)), nextBatch(0) {
+  if (fd.fd < 0)
+    throw std::runtime_error("failed to create socket");
+  sockaddr_un address = socketAddress(path);
+  if (connect(fd.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+    throw std::runtime_error("failed to connect to " + path);
+}
+
+ControlReply ControlClient::send(const std::vector<ControlCommand> &commands) {
+  if (commands.size() > CONTROL_MAX_COMMANDS)
+    throw std::runtime_error("too many commands in a batch");
+  ControlHeader header = {CONTROL_MAGIC, nextBatch++, static_cast<uint32_t>(commands.size())};
+  iovec parts[2] = {
+    {&header, sizeof(header)},
+    {const_cast<ControlCommand*>(commands.data()), commands.size() * sizeof(ControlCommand)}
+  };
+  msghdr message = {};
+  message.msg_iov = parts;
+  message.msg_iovlen = 2;
+  if (sendmsg(fd.fd, &message, MSG_NOSIGNAL) < 0)
+    throw std::runtime_error("failed to send a batch");
+
+  ControlReply reply;
+  ssize_t size;
+  do {
+    size = recv(fd.fd, &reply, sizeof(reply), 0);
+  } while (size < 0 && errno == EINTR);
+  if (size != sizeof(reply))
+    throw std::runtime_error("no reply from the server");
+  if (reply.batch != header.batch)
+    throw std::runtime_error("reply to another batch");
+  return reply;
+}
+
+void ControlClient::benchmark(uint32_t batches, uint32_t size, std::ostream &out) {
+  // Notes far past any song, so that they stay out of view. Every other
+  // batch removes the notes the previous one added.
+  std::vector<ControlCommand> commands(size);
+  uint64_t totalApply = 0, maxApply = 0, totalRound = 0, maxRound = 0;
+  uint64_t start = controlClock();
+  for (uint32_t i = 0; i < batches; ++i) {
+    for (uint32_t j = 0; j < size; ++j) {
+      ControlCommand &command = commands[j];
+      command.op = i % 2 ? ControlCommand::REMOVE_NOTE : ControlCommand::ADD_NOTE;
+      command.pitch = j % Layout::DRUM_KEY;
+      command.inst = j / Layout::DRUM_KEY % Layout::INSTS;
+      command.reserved = 0;
+      command.a = (1 << 20) + j;
+      command.b = 1;
+    }
+    uint64_t sent = controlClock();
+    ControlReply reply = send(commands);
+    uint64_t round = controlClock() - sent;
+    if (reply.status != ControlReply::OK)
+      throw std::runtime_error("batch rejected");
+    totalApply += reply.applyNs;
+    maxApply = std::max<uint64_t>(maxApply, reply.applyNs);
+    totalRound += round;
+    maxRound = std::max(maxRound, round);
+  }
+  double elapsed = (controlClock() - start) / 1e9;
+  out << "control: " << batches << " batches of " << size << " commands in " << elapsed
+    << " s, " << batches * static_cast<double>(size) / elapsed << " commands/s" << std::endl;
+  if (batches)
+    out << "apply latency mean " << totalApply / batches / 1000.0 << " us, max "
+      << maxApply / 1000.0 << " us; round trip mean " << totalRound / batches / 1000.0
+      << " us, max " << maxRound / 1000.0 << " us" << std::endl;
+}
@@ -0,0 +1,117 @@
+#ifndef _CONTROL_SERVER_H_
+#define _CONTROL_SERVER_H_
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FDGuard.h"
+
+// ControlServer: a Unix domain socket for scripts and editors to drive
+//   the sequencer. Each SOCK_SEQPACKET message is a batch of commands,
+//   received and checked on a background thread. The real-time loop
+//   takes all pending batches at a boundary and applies them at once:
+//   the note edits of all batches with the same result as in command
+//   order, then the last octave, instrument, seek and play command of
+//   any batch. So the view is redrawn once, however many commands
+//   there are.
+//   Every batch gets a reply with the state after it was applied.
+//   Clients only need this header and ControlServer.cpp.
+
+#define CONTROL_MAGIC        0x42434D46
+#define CONTROL_MAX_COMMANDS 4096
+
+// Little endian, as on both sides of the socket.
+struct ControlHeader {
+  uint32_t magic, batch, count;
+};
+
+struct ControlCommand {
+  enum Op : uint8_t {
+    // Note <a> <b> = start time and duration.
+    ADD_NOTE, REMOVE_NOTE,
+    // Step <a>.
+    SEEK,
+    PLAY, STOP,
+    // Octave or instrument <a>.
+    SET_OCTAVE, SET_INST,
+    // Only asks for the reply.
+    QUERY
+  };
+  uint8_t op, pitch, inst, reserved;
+  uint32_t a, b;
+};
+
+struct ControlReply {
+  enum Status : uint32_t { OK, BAD_BATCH, BAD_COMMAND };
+  uint32_t batch, status;
+  // Index of the bad command, or the number of commands.
+  uint32_t badCommand;
+  // From the arrival of the batch until it was applied.
+  uint32_t applyNs;
+  uint32_t timeBase, tilePos, noteCount;
+  uint8_t isPlaying, isRecording, activeOctave, activeInst;
+};
+
+// A batch as handed to the real-time loop, which fills in the reply.
+struct ControlBatch {
+  uint32_t client;
+  uint64_t arrival;
+  std::vector<ControlCommand> commands;
+  ControlReply reply;
+};
+
+class ControlServer {
+  std::string path;
+  FDGuard listener, poller, wakeRead, wakeWrite;
+  std::atomic<bool> stopping;
+
+  // Clients by id, only accessed by the background thread. Ids are not
+  // reused, so that a reply never goes to a later client.
+  std::map<uint32_t, int> clients;
+  uint32_t nextClient;
+  // One byte more than the largest batch, to tell longer ones apart.
+  std::vector<uint8_t> buffer;
+
+  // Mailboxes to and from the real-time loop. The batches and their
+  // memory go back to the background thread once applied.
+  std::mutex mailLock;
+  std::atomic<bool> hasPending;
+  std::vector<ControlBatch> pending, applied;
+
+  std::thread thread;
+  void threadMain();
+  void accept();
+  void receive(uint32_t client, int fd);
+  void sendReplies();
+  void send(uint32_t client, const ControlReply &reply);
+  void dropClient(uint32_t client);
+public:
+  explicit ControlServer(const std::string &path);
+  ~ControlServer();
+  // Takes the pending batches into an empty vector. Never blocks.
+  bool poll(std::vector<ControlBatch> &out);
+  // Hands back applied batches for their replies to be sent. Never
+  // blocks, returns false to be retried.
+  bool complete(std::vector<ControlBatch> &batches);
+};
+
+// Client side, one batch in flight at a time.
+class ControlClient {
+  FDGuard fd;
+  uint32_t nextBatch;
+public:
+  explicit ControlClient(const std::string &path);
+  ControlReply send(const std::vector<ControlCommand> &commands);
+  // Sends batches that add and then remove notes, and prints the
+  // commands per second and the latencies.
+  void benchmark(uint32_t batches, uint32_t size, std::ostream &out);
+};
+
+// Monotonic time in ns, as used for the arrival times.
+uint64_t controlClock();
+
+#endif
@@ -17,6 +17,8 @@ void Main::loadDrumLoop() {
     addDemoNote(i * 8 + 4, 1, 48, 4);
     addDemoNote(i * 8 + 6, 1, 48, 5);
   }
+  sequencer.setLoop(0, 16 * 8);
+  analyzeSong(false);
 }
 
 void Main::loadDemoSong() {
@@ -262,4 +264,5 @@ void Main::loadDemoSong() {
   addDemoNote(16 * 16, 32, 9, 2);
   addDemoNote(16 * 16, 6, 12 + 9, 1);
   addDemoNote(16 * 16 + 6, 26, 12 + 4, 1);
+  analyzeSong(false);
 }
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include "FrameRenderer.h"
+
+namespace {
+  // Height of each type of track.
+  const uint8_t HEI_WHITE = 11, HEI_BLACK = 9, HEI_DRUM = 7;
+
+  // Length of each segment.
+  const uint8_t LEN_WHITE = 80, LEN_BWGAP = 33, LEN_BLACK = 47;
+  const uint8_t LEN_OCTAVE = 8, LEN_TILE = 15;
+
+  // Colors.
+  const uint32_t CLR_WHITE_KEY = 0xFFFFFF, CLR_BLACK_KEY = 0x000000;
+  const uint32_t CLR_DRUM_KEY  = 0x1E1400, CLR_SEPARATOR = 0x444444;
+  const uint32_t CLR_TRACK_W   = 0x202020, CLR_TRACK_B   = 0x171717;
+  const uint32_t CLR_TRACK_D   = 0x2B1C00, CLR_16TH      = 0x303030;
+  const uint32_t CLR_4TH       = 0x70757F, CLR_WHOLE     = 0xFFFFFF;
+  const uint32_t CLR_CURSOR    = 0x20FF20, CLR_DRUM_TILE = 0xEFAE45;
+  const uint32_t CLR_EMPTY     = 0x000000, CLR_TILE_BDR  = 0xFFFFFF;
+
+  // graph_colors.
+  const uint32_t CLR_INSTS[8] = {
+    0xFFCF70, 0x77FF70, 0xF44141, 0x4286F4,
+    0xB241F4, 0xF49741, 0x41F4F4, 0x09BA00
+  };
+
+  enum State : uint8_t {
+    S_OCTAVE, S_SEPARATOR, S_CONTENT, S_WHITE_KEY, S_BLACK_KEY, S_DRUM_KEY
+  };
+
+  bool isBlack(uint8_t key) {
+    return key == 1 || key == 3 || key == 6 || key == 8 || key == 10;
+  }
+
+  uint8_t heightOf(uint8_t octave, uint8_t key) {
+    return octave == 4 ? HEI_DRUM : isBlack(key) ? HEI_BLACK : HEI_WHITE;
+  }
+}
+
+FrameRenderer::FrameRenderer(unsigned threads)
+    :input(nullptr), output(nullptr), generation(0), remaining(0), stopping(false) {
+  // The row machine of graph_main. A frame starts at the separator of
+  // octave 0. new_frame doesn't reset the column counters, so the first
+  // row starts with abs_ctr where the last blank line left it.
+  uint8_t state = S_SEPARATOR, track = 0, octave = 0, key = 0, heiCtr = 0;
+  bool isPrevBlack = false;
+  for (uint16_t i = 0; i < FRAME_HEIGHT; ++i) {
+    rows[i] = RowStart{state, track, octave, key, heiCtr, isPrevBlack,
+      static_cast<uint16_t>(i ? 0 : (FRAME_HTOTAL - 1) & 1023)};
+
+    // Rows without content end on the separator, see the column machine.
+    if (state == S_SEPARATOR || !heiCtr) {
+      heiCtr = 1;
+      state = S_OCTAVE;
+    } else if (heiCtr != heightOf(octave, key)) {
+      ++heiCtr;
+      state = S_OCTAVE;
+    } else {
+      heiCtr = 0;
+      track = (track + 1) & 63;
+      isPrevBlack = isBlack(key);
+      if (key == 11) {
+        key = 0;
+        octave = (octave + 1) & 7;
+        state = S_SEPARATOR;
+      } else {
+        ++key;
+        state = S_OCTAVE;
+      }
+    }
+  }
+
+  // The calling thread renders the first band.
+  if (!threads)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  band = (FRAME_HEIGHT + threads - 1) / threads;
+  for (uint16_t begin = band; begin < FRAME_HEIGHT; begin += band)
+    workers.emplace_back(&FrameRenderer::workerMain, this,
+      begin, std::min<uint16_t>(begin + band, FRAME_HEIGHT));
+}
+
+FrameRenderer::~FrameRenderer() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  started.notify_all();
+  for (std::thread &i : workers)
+    i.join();
+}
+
+void FrameRenderer::workerMain(uint16_t begin, uint16_t end) {
+  uint32_t done = 0;
+  for (;;) {
+    const DisplayState *in;
+    uint8_t *out;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      started.wait(guard, [&]() { return stopping || generation != done; });
+      if (stopping)
+        return;
+      done = generation;
+      in = input;
+      out = output;
+    }
+    renderRows(*in, out, begin, end);
+    std::lock_guard<std::mutex> guard(lock);
+    if (!--remaining)
+      finished.notify_one();
+  }
+}
+
+void FrameRenderer::renderRows(const DisplayState &in, uint8_t *out,
+    uint16_t begin, uint16_t end) const {
+  for (uint16_t y = begin; y < end; ++y) {
+    const RowStart &row = rows[y];
+    uint8_t state = row.state;
+    uint8_t wid = 0, tile = 0;
+    uint16_t abs = row.absCtr;
+
+    bool black = isBlack(row.key);
+    bool drum = row.octave == 4;
+    uint8_t heiNow = heightOf(row.octave, row.key);
+    uint8_t drumKey = row.key & 7;
+    uint8_t hei = row.heiCtr;
+
+    // graph_key_status.
+    uint8_t keyData = in.keys[drum ? 48 : row.track % 49];
+    bool keyActive = drum ? keyData >> drumKey & 1 : keyData != 0;
+    uint8_t keyInst = 7;
+    if (keyData >> in.activeInst & 1) {
+      keyInst = in.activeInst;
+    } else {
+      for (uint8_t i = 0; i < 8; ++i)
+        if (keyData >> i & 1) { keyInst = i; break; }
+    }
+
+    uint8_t *pixel = out + static_cast<size_t>(y) * FRAME_WIDTH * 3;
+    for (uint16_t x = 0; x < FRAME_WIDTH; ++x, pixel += 3) {
+      bool atCursor = ((abs - (LEN_WHITE + LEN_TILE * 8 - 1)) & 1023) < 3;
+      uint32_t color = 0;
+      switch (state) {
+      case S_WHITE_KEY:
+        if (black && hei == (HEI_BLACK + 1) >> 1)
+          color = CLR_SEPARATOR;
+        else
+          color = keyActive && !black ? CLR_INSTS[keyInst] : CLR_WHITE_KEY;
+        break;
+      case S_BLACK_KEY:
+        color = keyActive ? CLR_INSTS[keyInst] : CLR_BLACK_KEY;
+        break;
+      case S_DRUM_KEY:
+        color = wid == LEN_OCTAVE || wid == LEN_WHITE - 1
+          ? CLR_SEPARATOR : keyActive ? CLR_DRUM_TILE : CLR_DRUM_KEY;
+        break;
+      case S_SEPARATOR:
+        color = atCursor ? CLR_CURSOR : CLR_SEPARATOR;
+        break;
+      case S_CONTENT: {
+        // graph_content. The instrument of drum tiles is left undefined
+        // by the RTL, and rendered as instrument 0.
+        uint32_t data = in.tiles[((tile + in.tileOffset) & 63) * 49 + (drum ? 48 : row.track % 49)];
+        bool active, bdrBottom = false, bdrTop = false, bdrSide = false;
+        uint8_t inst = 0;
+        if (drum) {
+          active = data >> (drumKey * 3) & 1;
+          bdrBottom = data >> (drumKey * 3 + 1) & 1;
+          bdrTop = data >> (drumKey * 3 + 2) & 1;
+          bdrSide = true;
+        } else {
+          active = data >> (in.activeInst * 3) & 1;
+          if (active) {
+            inst = in.activeInst;
+            bdrBottom = data >> (in.activeInst * 3 + 1) & 1;
+            bdrTop = data >> (in.activeInst * 3 + 2) & 1;
+            bdrSide = true;
+          } else {
+            for (uint8_t i = 0; i < 8; ++i)
+              if (data >> (i * 3) & 1) { active = true; inst = i; break; }
+          }
+        }
+
+        uint8_t scrolledTile = (tile + in.gridScroll) & 63;
+        if (atCursor)
+          color = CLR_CURSOR;
+        else if (active)
+          color = (bdrBottom && wid < 2) || (bdrTop && wid >= LEN_TILE - 2)
+            || (bdrSide && (hei <= 2 || hei > heiNow - 2)) ? CLR_TILE_BDR : CLR_INSTS[inst];
+        else if (wid == LEN_TILE - 1)
+          color = (scrolledTile & 3) == 3
+            ? ((scrolledTile & 12) == 12 ? CLR_WHOLE : CLR_4TH) : CLR_16TH;
+        else
+          color = drum ? CLR_TRACK_D : black ? CLR_TRACK_B : CLR_TRACK_W;
+        break;
+      }
+      case S_OCTAVE:
+        if (wid == LEN_OCTAVE - 1)
+          color = CLR_SEPARATOR;
+        else if (row.octave == in.activeOctave)
+          color = drum ? CLR_DRUM_TILE : CLR_INSTS[in.activeInst & 7];
+        else
+          color = CLR_EMPTY;
+        break;
+      }
+      pixel[0] = color >> 16;
+      pixel[1] = color >> 8;
+      pixel[2] = color;
+
+      // Column machine, on new_col.
+      uint8_t nextWid = (wid + 1) & 127;
+      abs = (abs + 1) & 1023;
+      switch (state) {
+      case S_OCTAVE:
+        if (wid == LEN_OCTAVE - 1) {
+          if (drum)
+            state = hei ? S_DRUM_KEY : S_SEPARATOR;
+          else
+            state = hei || black || row.isPrevBlack ? S_WHITE_KEY : S_SEPARATOR;
+        }
+        break;
+      case S_WHITE_KEY:
+        if (wid == LEN_WHITE - 1) {
+          state = hei ? S_CONTENT : S_SEPARATOR;
+          nextWid = in.subtileScroll & 15;
+        } else if (black && wid == LEN_BWGAP - 1) {
+          state = S_BLACK_KEY;
+          nextWid = 0;
+        }
+        break;
+      case S_BLACK_KEY:
+        if (wid == LEN_BLACK - 1) {
+          state = hei ? S_CONTENT : S_SEPARATOR;
+          nextWid = in.subtileScroll & 15;
+        }
+        break;
+      case S_DRUM_KEY:
+        if (wid == LEN_WHITE - 1) {
+          state = S_CONTENT;
+          nextWid = in.subtileScroll & 15;
+        }
+        break;
+      case S_CONTENT:
+        if (wid == LEN_TILE - 1) {
+          nextWid = 0;
+          tile = (tile + 1) & 63;
+        }
+        break;
+      }
+      wid = nextWid;
+    }
+  }
+}
+
+void FrameRenderer::render(const DisplayState &in, uint8_t *out) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    input = &in;
+    output = out;
+    remaining = workers.size();
+    ++generation;
+  }
+  started.notify_all();
+  renderRows(in, out, 0, std::min<uint16_t>(band, FRAME_HEIGHT));
+  std::unique_lock<std::mutex> guard(lock);
+  finished.wait(guard, [&]() { return !remaining; });
+}
+
+void FrameRenderer::writePPM(std::ostream &out, const uint8_t *frame) {
+  out << "P6\n" << FRAME_WIDTH << " " << FRAME_HEIGHT << "\n255\n";
+  out.write(reinterpret_cast<const char*>(frame), FRAME_WIDTH * FRAME_HEIGHT * 3);
+}
+
+void FrameRenderer::savePPM(const std::string &path, const uint8_t *frame) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("failed to write " + path);
+  writePPM(file, frame);
+}
@@ -0,0 +1,67 @@
+#ifndef _FRAME_RENDERER_H_
+#define _FRAME_RENDERER_H_
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// FrameRenderer: software model of the piano roll drawn by graph_main,
+//   graph_content, graph_key_status and graph_colors in tile mode. It
+//   runs the same row and column state machines with the same geometry
+//   and palette, so that frames match the VGA output pixel for pixel,
+//   which FPGA/sim/graph_frame.cpp checks against the RTL.
+//   Rows are rendered in parallel, since the state at the start of each
+//   row only depends on the geometry. The workers are started once and
+//   each renders its band of every frame.
+
+// Visible part of the 1024x600 screen driven by vga_driver.
+#define FRAME_WIDTH  1024
+#define FRAME_HEIGHT 600
+// Columns per line including blanking, see vga_driver.sv.
+#define FRAME_HTOTAL 1312
+
+// Inputs of graph_main, in the geometry of the FPGA build.
+struct DisplayState {
+  uint32_t tiles[49 * 64];
+  uint8_t keys[49];
+  uint8_t subtileScroll, gridScroll, tileOffset;
+  uint8_t activeOctave, activeInst;
+};
+
+class FrameRenderer {
+  // State of the row machine at the start of each visible row.
+  struct RowStart {
+    uint8_t state, track, octave, key, heiCtr;
+    bool isPrevBlack;
+    uint16_t absCtr;
+  };
+  RowStart rows[FRAME_HEIGHT];
+  uint16_t band;
+
+  // The frame being rendered, a new one for each generation, and the
+  // workers yet to finish it.
+  std::mutex lock;
+  std::condition_variable started, finished;
+  const DisplayState *input;
+  uint8_t *output;
+  uint32_t generation;
+  unsigned remaining;
+  bool stopping;
+  std::vector<std::thread> workers;
+
+  void workerMain(uint16_t begin, uint16_t end);
+  void renderRows(const DisplayState &in, uint8_t *out, uint16_t begin, uint16_t end) const;
+public:
+  // With threads at 0, uses one thread per core.
+  explicit FrameRenderer(unsigned threads = 0);
+  ~FrameRenderer();
+  // Writes FRAME_WIDTH * FRAME_HEIGHT RGB pixels.
+  void render(const DisplayState &in, uint8_t *out);
+  static void writePPM(std::ostream &out, const uint8_t *frame);
+  static void savePPM(const std::string &path, const uint8_t *frame);
+};
+
+#endif
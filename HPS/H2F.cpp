@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <stdexcept>
 #include <unistd.h>
 #include <sys/fcntl.h>
@@ -5,9 +6,55 @@
 #include "H2F.h"
 
 #define H2F_LW_BASE 0xFF200000
-#define H2F_LW_SPAN 0x00000004
+#define H2F_LW_SPAN 0x00010000
 
-H2F::H2F() :mem(open("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC)) {
+// Pending key events the FPGA can hold, including the one waiting for
+// its time. It drops those pushed past this, see synthesizers.sv.
+#define H2F_KEY_EVENT_DEPTH 257
+
+// Delay of the simulated loopback from the output to the input, in
+// frames, and the period of the simulated output.
+#define H2F_SIM_LOOPBACK 240
+#define H2F_SIM_PERIOD   48
+
+#ifndef H2F_SIM
+// The register and window formats below are those of the FPGA build.
+static_assert(Layout::KEYS == 49 && Layout::INSTS == 8 && Layout::TILE_BITS == 3
+  && Layout::ROWS == 64 && Layout::ROWS_BELOW == 8, "the layout must match the FPGA build");
+#endif
+
+#ifdef H2F_SIM
+
+H2F::H2F(Capture *capture)
+    :mem(-1), capture(capture), simNow(0), simEventsDropped(false), simDirect(), simSched(),
+    simTiles(), simTileWrites(), simWrites(),
+    simCapture(), simLoopback(H2F_SIM_LOOPBACK), simCaptureStart(std::chrono::steady_clock::now()),
+    simCaptureFrames(0), simCaptureRead(0), simCaptureOverrun(false) {
+  base = new uint32_t[H2F_LW_SPAN / 4]();
+}
+
+H2F::~H2F() {
+  delete[] const_cast<uint32_t*>(base);
+}
+
+void H2F::getSimDisplay(DisplayState &out) const {
+  uint32_t view = base[0];
+  out.subtileScroll = view & 15;
+  out.gridScroll = view >> 4 & 15;
+  out.activeOctave = view >> 8 & 7;
+  out.activeInst = view >> 11 & 7;
+  out.tileOffset = base[4] & 63;
+  uint16_t tiles = sizeof(out.tiles) / sizeof(out.tiles[0]);
+  for (uint16_t i = 0; i < tiles; ++i)
+    out.tiles[i] = i < Layout::TILES ? static_cast<uint32_t>(simTiles[i]) : 0;
+  for (uint8_t i = 0; i < sizeof(out.keys); ++i)
+    out.keys[i] = i < Layout::KEYS ? getSimKeyState(i) : 0;
+}
+
+#else
+
+H2F::H2F(Capture *capture)
+    :mem(open("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC)), capture(capture) {
   if (mem.fd < 0)
     throw std::runtime_error("failed to open /dev/mem");
   void *base = mmap(nullptr, H2F_LW_SPAN, PROT_READ | PROT_WRITE,
@@ -21,9 +68,20 @@ H2F::~H2F() {
   munmap(const_cast<uint32_t*>(base), H2F_LW_SPAN);
 }
 
+#endif
+
+void H2F::write(uint32_t offset, uint32_t value) {
+  base[offset] = value;
+#ifdef H2F_SIM
+  ++simWrites;
+#endif
+  if (capture)
+    capture->onWrite(offset, value);
+}
+
 void H2F::setBits(uint32_t offset, uint8_t bStart, uint8_t bLen, uint32_t value) {
   uint32_t mask = ((uint32_t(1) << bLen) - 1) << bStart;
-  base[offset] = (base[offset] & ~mask) | (value << bStart & mask);
+  write(offset, (base[offset] & ~mask) | (value << bStart & mask));
 }
 
 void H2F::setSubtileScroll(uint8_t value) { setBits(0, 0,  4, value); }
@@ -32,15 +90,162 @@ void H2F::setActiveOctave(uint8_t value)  { setBits(0, 8,  3, value); }
 void H2F::setActiveInst(uint8_t value)    { setBits(0, 11, 3, value); }
 void H2F::setTileOffset(uint8_t value)    { setBits(4, 0,  6, value); }
 
-void H2F::setKeyState(uint8_t key, uint8_t value) {
+void H2F::setKeyState(uint8_t key, InstMask value) {
   setBits(0, 14, 14, static_cast<uint16_t>(value) << 6 | key);
+#ifdef H2F_SIM
+  simDirect[key] = value;
+#endif
+}
+
+void H2F::writeTiles(uint16_t addr, const TileState *data, uint16_t count) {
+  // Plain word stores: the window ignores byte enables, so this must
+  // not be replaced with memcpy, which may split into narrower accesses.
+  for (uint16_t i = 0; i < count; ++i)
+    write(H2F_WINDOW + addr + i, data[i]);
+#ifdef H2F_SIM
+  std::copy(data, data + count, simTiles + addr);
+  simTileWrites += count;
+#endif
+}
+
+void H2F::setNoteDisplay(bool on) {
+  write(H2F_WINDOW + H2F_NOTE_MODE, on);
+}
+
+void H2F::setViewPos(uint16_t value) {
+  write(H2F_WINDOW + H2F_VIEW_POS, value);
+}
+
+void H2F::setNoteSlot(uint8_t slot, uint16_t start, uint16_t end,
+    uint8_t pitch, uint8_t inst) {
+  // The slot is invalid until the attributes are written.
+  write(H2F_WINDOW + H2F_NOTE_RANGES + slot, static_cast<uint32_t>(end) << 16 | start);
+  write(H2F_WINDOW + H2F_NOTE_ATTRS + slot, 1 << 9 | (inst & 7) << 6 | (pitch & 63));
+}
+
+void H2F::clearNoteSlot(uint8_t slot) {
+  write(H2F_WINDOW + H2F_NOTE_ATTRS + slot, 0);
+}
+
+void H2F::pushKeyEvent(uint16_t sample, uint8_t key, InstMask value) {
+  uint32_t data = static_cast<uint32_t>(key & 63) << 22
+    | static_cast<uint32_t>(value & 0xFF) << 14 | (sample & 0x3FFF);
+  write(H2F_WINDOW + H2F_KEY_EVENT, data);
+#ifdef H2F_SIM
+  // The FPGA takes due events far faster than they can be pushed.
+  simApplyEvents(simNow);
+  if (simEvents.size() < H2F_KEY_EVENT_DEPTH)
+    simEvents.push_back({static_cast<uint16_t>(sample & 0x3FFF), key, value});
+  else
+    simEventsDropped = true;
+#endif
+}
+
+void H2F::flushKeyEvents() {
+  write(H2F_WINDOW + H2F_KEY_FLUSH, 1);
+#ifdef H2F_SIM
+  simEvents.clear();
+  simEventsDropped = false;
+  for (InstMask &i : simSched)
+    i = 0;
+#endif
+}
+
+bool H2F::keyEventsDropped() {
+#ifdef H2F_SIM
+  return simEventsDropped;
+#else
+  return base[H2F_WINDOW + H2F_KEY_EVENT] & 1;
+#endif
+}
+
+#ifdef H2F_SIM
+
+void H2F::simApplyEvents(uint16_t now) {
+  // An event is due once the sample counter is at most half of its
+  // range past the event's time, same as in synthesizers.sv.
+  while (!simEvents.empty()) {
+    const SimEvent &event = simEvents.front();
+    if ((now - event.sample) & 0x2000)
+      break;
+    simSched[event.key] = event.value;
+    simEvents.pop_front();
+  }
+}
+
+void H2F::simCaptureAdvance() {
+  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - simCaptureStart;
+  uint64_t target = static_cast<uint64_t>(elapsed.count()) * 48 / 1000000;
+  // After a long pause, only the frames still in the ring are produced.
+  if (target - simCaptureFrames > H2F_CAPTURE_FRAMES) {
+    simCaptureFrames = target - H2F_CAPTURE_FRAMES;
+    simCaptureOverrun = true;
+  }
+  int32_t amp = 0;
+  for (uint8_t i = 0; i < Layout::KEYS; ++i)
+    for (InstMask j = getSimKeyState(i); j; j &= j - 1)
+      amp = std::min(amp + 0x100000, 0x7FFFFF);
+  for (; simCaptureFrames < target; ++simCaptureFrames) {
+    uint16_t frame = simCaptureFrames;
+    if (static_cast<uint16_t>(frame - simCaptureRead) >= H2F_CAPTURE_FRAMES)
+      simCaptureOverrun = true;
+    int32_t out = simCaptureFrames / (H2F_SIM_PERIOD / 2) & 1 ? -amp : amp;
+    int32_t in = simLoopback.front();
+    simLoopback.pop_front();
+    simLoopback.push_back(out);
+    uint32_t in16 = static_cast<uint32_t>(in) >> 8 & 0xFFFF;
+    simCapture[0][frame % H2F_CAPTURE_FRAMES] = in16 << 16 | in16;
+    simCapture[1][frame % H2F_CAPTURE_FRAMES] = out;
+  }
+}
+
+#endif
+
+uint32_t H2F::getCaptureStatus() {
+#ifdef H2F_SIM
+  simCaptureAdvance();
+  uint16_t written = simCaptureFrames;
+  uint16_t level = written - simCaptureRead;
+  return (level >= H2F_CAPTURE_FRAMES / 2 ? H2F_CAPTURE_HIGH_WATER : 0)
+    | (simCaptureOverrun ? H2F_CAPTURE_OVERRUN : 0) | written;
+#else
+  return base[H2F_WINDOW + H2F_CAPTURE_STATUS];
+#endif
+}
+
+void H2F::readCapture(uint16_t first, uint16_t count, uint32_t *inputs, uint32_t *outputs) {
+#ifdef H2F_SIM
+  const volatile uint32_t *in = simCapture[0], *out = simCapture[1];
+#else
+  const volatile uint32_t *in = base + H2F_WINDOW + H2F_CAPTURE_INPUTS;
+  const volatile uint32_t *out = base + H2F_WINDOW + H2F_CAPTURE_OUTPUTS;
+#endif
+  // One plane after the other, so that the addresses are consecutive.
+  for (uint16_t i = 0; i < count; ++i)
+    inputs[i] = in[(first + i) % H2F_CAPTURE_FRAMES];
+  for (uint16_t i = 0; i < count; ++i)
+    outputs[i] = out[(first + i) % H2F_CAPTURE_FRAMES];
 }
 
-void H2F::setTileState(uint16_t addr, uint32_t data) {
-  setBits(4, 6, 12, addr);
-  setBits(8, 0, 24, data);
+void H2F::ackCapture(uint16_t count) {
+  base[H2F_WINDOW + H2F_CAPTURE_ACK] = count;
+#ifdef H2F_SIM
+  simCaptureRead = count;
+  simCaptureOverrun = false;
+#endif
 }
 
 uint32_t H2F::getInputs() {
-  return base[12];
+  uint32_t value;
+  if (capture && capture->isReplaying())
+    value = capture->nextInput();
+  else
+    value = base[12];
+#ifdef H2F_SIM
+  simNow = value >> 18;
+  simApplyEvents(simNow);
+#endif
+  if (capture)
+    capture->onInput(value);
+  return value;
 }
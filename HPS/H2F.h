@@ -2,25 +2,120 @@
 #define _H2F_H_
 #include <cstdint>
 #include "FDGuard.h"
+#include "Capture.h"
+#include "Layout.h"
+#ifdef H2F_SIM
+#include <chrono>
+#include <deque>
+#include "FrameRenderer.h"
+#endif
 
 // This class handles HPS to FPGA communication.
+// Define H2F_SIM to replace the bridge with plain memory, so that the
+// rest of the program can run on a PC.
 // Author: Yibo Cao
 
+// Word offsets of the memory-mapped window and its regions, see
+// h2f_window.sv. FPGA/sim/h2f_window.cpp checks them against it.
+#define H2F_WINDOW      0x2000
+#define H2F_NOTE_RANGES 0x1000
+#define H2F_NOTE_ATTRS  0x1100
+#define H2F_NOTE_MODE   0x1F00
+#define H2F_VIEW_POS    0x1F01
+#define H2F_KEY_EVENT   0x1F02
+#define H2F_KEY_FLUSH   0x1F03
+#define H2F_CAPTURE_INPUTS  0x1400
+#define H2F_CAPTURE_OUTPUTS 0x1800
+#define H2F_CAPTURE_STATUS  0x1F04
+#define H2F_CAPTURE_ACK     0x1F05
+
+// Audio capture ring, see capture_buffer.sv, and its status bits. The
+// low 16 bits of the status are the frames written since the reset.
+#define H2F_CAPTURE_FRAMES     1024
+#define H2F_CAPTURE_HIGH_WATER (1u << 31)
+#define H2F_CAPTURE_OVERRUN    (1u << 30)
+// Key events are timed by the low 14 bits of the sample counter, and
+// synthesizers.sv takes events up to 8192 samples ahead as past ones.
+// Events are pushed at most this far ahead, which leaves the rest of
+// that range for an update to come late.
+#define H2F_KEY_EVENT_HORIZON 4096
+
 class H2F {
   FDGuard mem;
   volatile uint32_t *base;
+  Capture *capture;
+  void write(uint32_t offset, uint32_t value);
   void setBits(uint32_t offset, uint8_t bStart, uint8_t bLen, uint32_t value);
+#ifdef H2F_SIM
+  // Model of the key event FIFO in synthesizers.sv, and of the tile
+  // memory. These hold any layout, not only what the FPGA build fits.
+  struct SimEvent { uint16_t sample; uint8_t key; InstMask value; };
+  std::deque<SimEvent> simEvents;
+  uint16_t simNow;
+  bool simEventsDropped;
+  InstMask simDirect[Layout::KEYS], simSched[Layout::KEYS];
+  TileState simTiles[Layout::TILES];
+  uint64_t simTileWrites, simWrites;
+  void simApplyEvents(uint16_t now);
+
+  // Model of the codec and the capture ring. Frames are produced in real
+  // time, and the output is a square wave as loud as the number of held
+  // keys, looped back to the input H2F_SIM_LOOPBACK frames later.
+  uint32_t simCapture[2][H2F_CAPTURE_FRAMES];
+  std::deque<int32_t> simLoopback;
+  std::chrono::steady_clock::time_point simCaptureStart;
+  uint64_t simCaptureFrames;
+  uint16_t simCaptureRead;
+  bool simCaptureOverrun;
+  void simCaptureAdvance();
+#endif
 public:
-  H2F();
+  // With a capture, the bridge traffic is recorded or replayed.
+  explicit H2F(Capture *capture = nullptr);
   ~H2F();
   void setSubtileScroll(uint8_t value);
   void setGridScroll(uint8_t value);
   void setActiveOctave(uint8_t value);
   void setActiveInst(uint8_t value);
-  void setKeyState(uint8_t key, uint8_t value);
+  void setKeyState(uint8_t key, InstMask value);
   void setTileOffset(uint8_t value);
-  void setTileState(uint16_t addr, uint32_t data);
+  // Writes consecutive tiles through the memory-mapped window.
+  void writeTiles(uint16_t addr, const TileState *data, uint16_t count);
+  // Note list display, see graph_notes.sv.
+  void setNoteDisplay(bool on);
+  void setViewPos(uint16_t value);
+  void setNoteSlot(uint8_t slot, uint16_t start, uint16_t end,
+    uint8_t pitch, uint8_t inst);
+  void clearNoteSlot(uint8_t slot);
+  // Key events applied by the FPGA when the sample counter reaches
+  // the given value. Events must be pushed in the order of their times.
+  void pushKeyEvent(uint16_t sample, uint8_t key, InstMask value);
+  // Drops pending events and clears the key states set by events.
+  void flushKeyEvents();
+  // Whether an event was dropped on a full FIFO since the last flush.
+  bool keyEventsDropped();
   uint32_t getInputs();
+  // Audio capture. This traffic bypasses the capture of the bridge
+  // traffic, since the audio can't be replayed.
+  uint32_t getCaptureStatus();
+  // Copies count frames starting from frame first of the ring, which
+  // may wrap around, with word loads.
+  void readCapture(uint16_t first, uint16_t count, uint32_t *inputs, uint32_t *outputs);
+  // Frames read so far, which also clears the overrun flag.
+  void ackCapture(uint16_t count);
+  // False once a replayed capture runs out of inputs.
+  bool hasInputs() const { return !capture || capture->hasInputs(); }
+#ifdef H2F_SIM
+  // Key state heard by the synthesizers.
+  InstMask getSimKeyState(uint8_t key) const { return simDirect[key] | simSched[key]; }
+  // Tile memory as written through the window, and the number of writes.
+  TileState getSimTile(uint16_t addr) const { return simTiles[addr]; }
+  uint64_t getSimTileWrites() const { return simTileWrites; }
+  // All writes to the bridge.
+  uint64_t getSimWrites() const { return simWrites; }
+  // Inputs of graph_main, as far as they fit its geometry.
+  void getSimDisplay(DisplayState &out) const;
+#endif
 };
 
 #endif
@@ -1,16 +1,30 @@
+#include <algorithm>
 #include "Keyboard.h"
 
-Keyboard::Keyboard(H2F &h2f) :h2f(h2f), monitor(), sequencer() {
-  for (uint8_t i = 0; i < 49; ++i)
+Keyboard::Keyboard(H2F &h2f)
+    :h2f(h2f), monitor(), sequencer(), eventMode(), eventTime() {
+  for (uint8_t i = 0; i < Layout::KEYS; ++i)
     h2f.setKeyState(i, 0);
 }
 
-void Keyboard::setKey(uint8_t to[49], uint8_t pitch, uint8_t inst, bool on) {
-  uint8_t &key = to[pitch];
-  uint8_t mask = 1 << inst;
+void Keyboard::setEventMode(bool on) {
+  clearSequencer();
+  eventMode = on;
+}
+
+void Keyboard::setKey(InstMask to[Layout::KEYS], uint8_t pitch, uint8_t inst, bool on) {
+  InstMask &key = to[pitch];
+  InstMask mask = 1 << inst;
   if (on) key |= mask;
   else key &= ~mask;
-  h2f.setKeyState(pitch, monitor[pitch] | sequencer[pitch]);
+  if (eventMode) {
+    if (to == sequencer)
+      h2f.pushKeyEvent(eventTime, pitch, sequencer[pitch]);
+    else
+      h2f.setKeyState(pitch, monitor[pitch]);
+  } else {
+    h2f.setKeyState(pitch, monitor[pitch] | sequencer[pitch]);
+  }
 }
 
 void Keyboard::setMonitor(uint8_t pitch, uint8_t inst, bool on) {
@@ -21,11 +35,32 @@ void Keyboard::setSequencer(uint8_t pitch, uint8_t inst, bool on) {
   setKey(sequencer, pitch, inst, on);
 }
 
+void Keyboard::setSequencerKeys(uint8_t pitch, InstMask insts) {
+  if (sequencer[pitch] != insts) {
+    sequencer[pitch] = insts;
+    if (eventMode)
+      h2f.pushKeyEvent(eventTime, pitch, insts);
+    else
+      h2f.setKeyState(pitch, monitor[pitch] | insts);
+  }
+}
+
 void Keyboard::clearSequencer() {
-  for (uint8_t i = 0; i < 49; ++i) {
+  if (eventMode) {
+    h2f.flushKeyEvents();
+    for (InstMask &i : sequencer)
+      i = 0;
+    return;
+  }
+  for (uint8_t i = 0; i < Layout::KEYS; ++i) {
     if (sequencer[i]) {
       sequencer[i] = 0;
       h2f.setKeyState(i, monitor[i]);
     }
   }
 }
+
+void Keyboard::getStatus(StatusData &out) const {
+  std::copy(monitor, monitor + Layout::KEYS, out.monitorKeys);
+  std::copy(sequencer, sequencer + Layout::KEYS, out.sequencerKeys);
+}
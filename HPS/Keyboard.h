@@ -1,19 +1,33 @@
 #ifndef _KEYBOARD_H_
 #define _KEYBOARD_H_
 #include "H2F.h"
+#include "Layout.h"
+#include "StatusPage.h"
 
 // Keyboard: manages the keyboard display at the bottom of the screen.
+//   In event mode, sequencer states are sent as timestamped events
+//   instead, so that they reach the synthesizers on an exact sample.
 // Author: Yibo Cao
 
 class Keyboard {
+  friend class ViewChecker;
   H2F &h2f;
-  uint8_t monitor[49], sequencer[49];
-  void setKey(uint8_t to[49], uint8_t pitch, uint8_t inst, bool on);
+  InstMask monitor[Layout::KEYS], sequencer[Layout::KEYS];
+  bool eventMode;
+  uint16_t eventTime;
+  void setKey(InstMask to[Layout::KEYS], uint8_t pitch, uint8_t inst, bool on);
 public:
   Keyboard(H2F &h2f);
+  void setEventMode(bool on);
+  bool isEventMode() const { return eventMode; }
+  // Sample count at which subsequent sequencer changes take effect.
+  void setEventTime(uint16_t sample) { eventTime = sample; }
   void setMonitor(uint8_t pitch, uint8_t inst, bool on);
   void setSequencer(uint8_t pitch, uint8_t inst, bool on);
+  // Sets the sequencer states of all instruments of a key at once.
+  void setSequencerKeys(uint8_t pitch, InstMask insts);
   void clearSequencer();
+  void getStatus(StatusData &out) const;
 };
 
 #endif
@@ -0,0 +1,51 @@
+#ifndef _LAYOUT_H_
+#define _LAYOUT_H_
+#include <cstdint>
+#include <type_traits>
+
+// Layout: geometry of the keyboard and the sequencer grid. Everything
+//   sized by keys, rows or instruments derives from here, so another
+//   geometry only needs these values changed. The bridge formats of the
+//   FPGA build are checked against them in H2F.cpp.
+
+namespace Layout {
+  // Tonal keys in octaves, followed by one key for the drums.
+  constexpr uint8_t KEYS_PER_OCTAVE = 12;
+  constexpr uint8_t OCTAVES = 4;
+  constexpr uint8_t KEYS = OCTAVES * KEYS_PER_OCTAVE + 1;
+  constexpr uint8_t DRUM_KEY = KEYS - 1;
+  // The active octave selecting the drums.
+  constexpr uint8_t DRUM_OCTAVE = OCTAVES;
+
+  // Instruments, each with a bit in the key masks and TILE_BITS bits of
+  // state in a tile. On the drum key, the instruments are the drums
+  // played by the first keys of the keyboard.
+  constexpr uint8_t INSTS = 8;
+  constexpr uint8_t DRUM_KEYS = INSTS < KEYS_PER_OCTAVE ? INSTS : KEYS_PER_OCTAVE;
+  constexpr uint8_t TILE_BITS = 3;
+
+  // Rows of the grid: ROWS_BELOW rows below the current position, and
+  // the rest above it. Rows are a ring indexed by a wrapping uint8_t
+  // offset and tracked in a 64-bit dirty mask.
+  constexpr uint8_t ROWS = 64;
+  constexpr uint8_t ROWS_BELOW = 8;
+  constexpr uint8_t ROWS_ABOVE = ROWS - ROWS_BELOW - 1;
+  constexpr uint16_t TILES = KEYS * ROWS;
+
+  static_assert(ROWS <= 64 && !(ROWS & (ROWS - 1)), "ROWS must be a power of two up to 64");
+  static_assert(ROWS_BELOW < ROWS, "ROWS_BELOW must be less than ROWS");
+  static_assert(DRUM_KEY < 255, "too many keys");
+  static_assert(INSTS <= 16, "too many instruments");
+
+  // Physical address of a tile in the ring of rows.
+  constexpr uint16_t tileAddr(uint8_t row, uint8_t pitch) {
+    return static_cast<uint16_t>(row & (ROWS - 1)) * KEYS + pitch;
+  }
+}
+
+// Instrument mask of a key, and the states of all instruments in a tile.
+using InstMask = std::conditional<Layout::INSTS <= 8, uint8_t, uint16_t>::type;
+using TileState = std::conditional<Layout::INSTS * Layout::TILE_BITS <= 32,
+  uint32_t, uint64_t>::type;
+
+#endif
@@ -1,21 +1,35 @@
 #include "Main.h"
+#include "Tables.h"
+#include "ViewChecker.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
 #include <exception>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <string>
+#include <vector>
 
-Main::Main() :h2f(), buttons(*this), keyboard(h2f),
-    sequencer(h2f, keyboard, *this),
-    timeBase(0), keyInputs(0), activeOctave(1), activeInst(0) {
+namespace {
+  volatile std::sig_atomic_t stopRequested = 0;
+  void onStopSignal(int) { stopRequested = 1; }
+}
+
+Main::Main(Capture *capture) :h2f(capture), buttons(*this), keyboard(h2f),
+    sequencer(h2f, keyboard, *this), midiHeld(), midiInputs(0), iterations(0), boundaries(0),
+    maxIterationSamples(0), lastPublish(0), timeBase(0), sampleOffset(0), keyInputs(0), wasRecording(false), songRequested(false), playSwitch(false), playing(false),
+    latencyProbes(false), probeHeld(false), probeFrame(0), activeOctave(1), activeInst(0) {
   // Initialize registers.
   h2f.setActiveOctave(activeOctave);
   h2f.setActiveInst(activeInst);
 }
 
 void Main::onKeyInputChange(uint8_t key, bool on) {
-  if (activeOctave == 4) {
-    if (key < 8) onKeyInputChange(48, key, on);
+  if (activeOctave == Layout::DRUM_OCTAVE) {
+    if (key < Layout::DRUM_KEYS) onKeyInputChange(Layout::DRUM_KEY, key, on);
   } else {
-    onKeyInputChange(12 * activeOctave + key, activeInst, on);
+    onKeyInputChange(Layout::KEYS_PER_OCTAVE * activeOctave + key, activeInst, on);
   }
 }
 
@@ -23,9 +37,57 @@ void Main::onKeyInputChange(uint8_t pitch, uint8_t inst, bool on) {
   keyboard.setMonitor(pitch, inst, on);
 }
 
+void Main::onMidiEvent(const MidiEvent &event) {
+  // Notes on the drum channel play the drums from MIDI_DRUM_NOTE, and
+  // notes on other channels play the active instrument.
+  bool isDrum = event.channel == MIDI_DRUM_CHANNEL;
+  uint8_t &held = midiHeld[isDrum][event.note];
+  uint8_t pitch, inst, key;
+  if (isDrum) {
+    if (event.note < MIDI_DRUM_NOTE || event.note >= MIDI_DRUM_NOTE + Layout::DRUM_KEYS)
+      return;
+    pitch = Layout::DRUM_KEY;
+    inst = key = event.note - MIDI_DRUM_NOTE;
+  } else {
+    if (event.note < MIDI_BASE_NOTE || event.note >= MIDI_BASE_NOTE + Layout::DRUM_KEY)
+      return;
+    pitch = event.note - MIDI_BASE_NOTE;
+    key = pitch % Layout::KEYS_PER_OCTAVE;
+    // A note is released on the instrument it was pressed with.
+    inst = event.on ? activeInst : held - 1;
+  }
+  if (event.on == static_cast<bool>(held))
+    return;
+  held = event.on ? inst + 1 : 0;
+  onKeyInputChange(pitch, inst, event.on);
+
+  // Record notes in the recording range, like the keyboard.
+  bool inRange = isDrum ? activeOctave == Layout::DRUM_OCTAVE
+    : pitch / Layout::KEYS_PER_OCTAVE == activeOctave && inst == activeInst;
+  if (inRange) {
+    sequencer.onRecordKey(key, event.on);
+    if (event.on) midiInputs |= 1 << key;
+    else midiInputs &= ~(1 << key);
+  }
+}
+
+void Main::updateMidiInputs() {
+  midiInputs = 0;
+  if (activeOctave == Layout::DRUM_OCTAVE) {
+    for (uint8_t i = 0; i < Layout::DRUM_KEYS; ++i)
+      if (midiHeld[1][MIDI_DRUM_NOTE + i])
+        midiInputs |= 1 << i;
+  } else {
+    uint8_t base = MIDI_BASE_NOTE + Layout::KEYS_PER_OCTAVE * activeOctave;
+    for (uint8_t i = 0; i < Layout::KEYS_PER_OCTAVE; ++i)
+      if (midiHeld[0][base + i] == activeInst + 1)
+        midiInputs |= 1 << i;
+  }
+}
+
 void Main::setOctave(uint8_t which) {
   // Unregister pressed keys in old octave.
-  for (uint8_t i = 0; i < 12; ++i)
+  for (uint8_t i = 0; i < Layout::KEYS_PER_OCTAVE; ++i)
     if (keyInputs & (1 << i))
       onKeyInputChange(i, false);
 
@@ -33,15 +95,16 @@ void Main::setOctave(uint8_t which) {
   h2f.setActiveOctave(activeOctave = which);
 
   // Register pressed keys in new octave.
-  for (uint8_t i = 0; i < 12; ++i)
+  for (uint8_t i = 0; i < Layout::KEYS_PER_OCTAVE; ++i)
     if (keyInputs & (1 << i))
       onKeyInputChange(i, true);
+  updateMidiInputs();
 }
 
 void Main::setInst(uint8_t which) {
-  if (activeOctave != 4) {
+  if (activeOctave != Layout::DRUM_OCTAVE) {
     // Unregister pressed keys for old instrument.
-    for (uint8_t i = 0; i < 12; ++i)
+    for (uint8_t i = 0; i < Layout::KEYS_PER_OCTAVE; ++i)
       if (keyInputs & (1 << i))
         onKeyInputChange(i, false);
   }
@@ -49,28 +112,29 @@ void Main::setInst(uint8_t which) {
   // Change instrument.
   h2f.setActiveInst(activeInst = which);
 
-  if (activeOctave != 4) {
+  if (activeOctave != Layout::DRUM_OCTAVE) {
     // Register pressed keys for new instrument.
-    for (uint8_t i = 0; i < 12; ++i)
+    for (uint8_t i = 0; i < Layout::KEYS_PER_OCTAVE; ++i)
       if (keyInputs & (1 << i))
         onKeyInputChange(i, true);
   }
+  updateMidiInputs();
 }
 
 void Main::shiftOctave(bool positive) {
   if (sequencer.shouldLockView()) return;
   if (positive)
-    setOctave(activeOctave == 4 ? 0 : activeOctave + 1);
+    setOctave(activeOctave == Layout::DRUM_OCTAVE ? 0 : activeOctave + 1);
   else
-    setOctave(activeOctave == 0 ? 4 : activeOctave - 1);
+    setOctave(activeOctave == 0 ? Layout::DRUM_OCTAVE : activeOctave - 1);
 }
 
 void Main::shiftInst(bool positive) {
   if (sequencer.shouldLockView()) return;
   if (positive)
-    setInst(activeInst == 7 ? 0 : activeInst + 1);
+    setInst(activeInst == Layout::INSTS - 1 ? 0 : activeInst + 1);
   else
-    setInst(activeInst == 0 ? 7 : activeInst - 1);
+    setInst(activeInst == 0 ? Layout::INSTS - 1 : activeInst - 1);
 }
 
 void Main::scrollScreen(bool positive) {
@@ -78,44 +142,486 @@ void Main::scrollScreen(bool positive) {
   sequencer.scroll(positive);
 }
 
+void Main::nextSong() {
+  if (sequencer.shouldLockView() || !setlist) return;
+  songRequested = true;
+}
+
+bool Main::switchSong() {
+  auto start = std::chrono::steady_clock::now();
+  std::unique_ptr<LoadedSong> song = setlist->take();
+  if (!song) return false;
+  sequencer.swapSong(*song);
+  // Edits of the song file apply once the song is active.
+  songWatcher.swap(song->watcher);
+  sequencer.flushTiles();
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+  song->switchUs = elapsed.count();
+  // The old song, now in song, is freed by the loader thread, which
+  // also prints the switch.
+  setlist->retire(std::move(song));
+  return true;
+}
+
 void Main::run() {
   uint16_t prevSampleCount;
-  for (bool firstCycle = true; ; firstCycle = false) {
+  for (bool firstCycle = true; !stopRequested && h2f.hasInputs(); firstCycle = false) {
     // Sample inputs.
     uint32_t rawInput = h2f.getInputs();
 
     // Update time base.
     uint16_t nowSampleCount = rawInput >> 18;
-    if (!firstCycle)
-      timeBase += (nowSampleCount - prevSampleCount) & 0x3FFF;
+    if (firstCycle) {
+      sampleOffset = nowSampleCount;
+    } else {
+      uint16_t elapsed = (nowSampleCount - prevSampleCount) & 0x3FFF;
+      timeBase += elapsed;
+      maxIterationSamples = std::max<uint32_t>(maxIterationSamples, elapsed);
+    }
     prevSampleCount = nowSampleCount;
+    ++iterations;
+
+    // The play switch takes over again when it moves.
+    bool playSwitchNew = rawInput & (1 << 4);
+    if (playSwitchNew != playSwitch)
+      playing = playSwitch = playSwitchNew;
 
     // Process KEY[3:0] inputs.
     buttons.update(~rawInput);
 
     // Process keyboard input.
     uint16_t keyInputsNew = rawInput >> 6;
-    for (uint8_t i = 0; i < 12; ++i)
+    for (uint8_t i = 0; i < Layout::KEYS_PER_OCTAVE; ++i)
       if ((keyInputs & (1 << i)) != (keyInputsNew & (1 << i)))
         onKeyInputChange(i, keyInputsNew & (1 << i));
     keyInputs = keyInputsNew;
 
+    // Process MIDI input.
+    MidiEvent event;
+    while (midi && midi->poll(event)) {
+      onMidiEvent(event);
+      midi->onApplied(event);
+    }
+
     // Playback and recording.
-    sequencer.update(rawInput & (1 << 4), rawInput & (1 << 5), keyInputs);
+    bool atBoundary = sequencer.update(
+      playing, rawInput & (1 << 5), keyInputs | midiInputs);
+
+    // Check the recorded notes when recording ends.
+    bool recording = playing && rawInput & (1 << 5);
+    if (wasRecording && !recording)
+      analyzeSong(true);
+    wasRecording = recording;
+
+    // Switch songs, waiting for the next one to be loaded if needed.
+    if (atBoundary && songRequested && switchSong())
+      songRequested = false;
+
+    // Apply edits of the song file, and hand the diff back to be freed.
+    if (atBoundary && !songDiff && songWatcher && songWatcher->poll(songDiff))
+      sequencer.applyDiff(*songDiff);
+    if (songDiff && songWatcher)
+      songWatcher->complete(songDiff);
+
+    // Apply the pending control batches together, and hand them back
+    // for the replies.
+    if (control) {
+      if (atBoundary && controlBatches.empty() && control->poll(controlBatches))
+        applyControl();
+      if (!controlBatches.empty())
+        control->complete(controlBatches);
+    }
+
+    // Write changed tiles.
+    sequencer.flushTiles();
+
+    // Copy out the captured audio.
+    if (audio) {
+      audio->poll();
+      if (latencyProbes)
+        probeLatency();
+    }
+
+    // Publish the status once per boundary, or as often while stopped.
+    if (atBoundary && status && (playing
+        || timeBase - lastPublish >= sequencer.getStepLength()))
+      publishStatus();
+  }
+}
+
+void Main::openStatusPage(const std::string &name) {
+  status.reset(new StatusPublisher(name));
+  publishStatus();
+}
+
+void Main::openMidiInput(const std::string &path) {
+  midi.reset(new MidiInput(path));
+}
+
+void Main::reportMidiInput(std::ostream &out) const {
+  if (midi) midi->report(out);
+}
+
+void Main::openControlSocket(const std::string &path) {
+  control.reset(new ControlServer(path));
+}
+
+void Main::applyControl() {
+  controlEdits.clear();
+  controlDiff.added.clear();
+  controlDiff.removed.clear();
+  bool setOctaveTo = false, setInstTo = false, seekTo = false, playTo = false;
+  uint32_t octave = 0, inst = 0, step = 0;
+  bool play = false;
+  for (const ControlBatch &batch : controlBatches) {
+    for (const ControlCommand &i : batch.commands) {
+      switch (i.op) {
+        case ControlCommand::ADD_NOTE:
+        case ControlCommand::REMOVE_NOTE: {
+          Note note;
+          note.startTime = i.a;
+          note.duration = i.b;
+          note.pitch = i.pitch;
+          note.inst = i.inst;
+          uint32_t order = controlEdits.size();
+          controlEdits.push_back(ControlEdit{note, order, i.op == ControlCommand::ADD_NOTE});
+          break;
+        }
+        case ControlCommand::SEEK:
+          seekTo = true;
+          step = i.a;
+          break;
+        case ControlCommand::PLAY:
+        case ControlCommand::STOP:
+          playTo = true;
+          play = i.op == ControlCommand::PLAY;
+          break;
+        case ControlCommand::SET_OCTAVE:
+          setOctaveTo = true;
+          octave = i.a;
+          break;
+        case ControlCommand::SET_INST:
+          setInstTo = true;
+          inst = i.a;
+          break;
+      }
+    }
+  }
+
+  // A diff applies its removals first, so an add followed by a remove of
+  // the same note cancel out instead, while a remove followed by an add
+  // stays both. Edits of the same note are grouped by sorting.
+  LessNoteContent less;
+  std::sort(controlEdits.begin(), controlEdits.end(),
+    [&](const ControlEdit &x, const ControlEdit &y) {
+      if (less(x.note, y.note)) return true;
+      if (less(y.note, x.note)) return false;
+      return x.order < y.order;
+    });
+  for (size_t i = 0, j; i < controlEdits.size(); i = j) {
+    uint32_t adds = 0;
+    for (j = i; j < controlEdits.size() && !less(controlEdits[i].note, controlEdits[j].note); ++j) {
+      if (controlEdits[j].add)
+        ++adds;
+      else if (adds)
+        --adds;
+      else
+        controlDiff.removed.push_back(controlEdits[j].note);
+    }
+    controlDiff.added.insert(controlDiff.added.end(), adds, controlEdits[i].note);
   }
+  if (!controlDiff.added.empty() || !controlDiff.removed.empty())
+    sequencer.applyDiff(controlDiff);
+  // Like the buttons, these wait while recording.
+  if (!sequencer.shouldLockView()) {
+    if (setOctaveTo && octave != activeOctave) setOctave(octave);
+    if (setInstTo && inst != activeInst) setInst(inst);
+    if (seekTo) sequencer.seek(step);
+  }
+  if (playTo) playing = play;
+
+  StatusData state;
+  sequencer.getStatus(state);
+  uint64_t now = controlClock();
+  for (ControlBatch &i : controlBatches) {
+    ControlReply &reply = i.reply;
+    reply.status = ControlReply::OK;
+    reply.applyNs = std::min<uint64_t>(now - i.arrival, UINT32_MAX);
+    reply.timeBase = timeBase;
+    reply.tilePos = state.tilePos;
+    reply.noteCount = state.noteCount;
+    reply.isPlaying = playing;
+    reply.isRecording = state.isRecording;
+    reply.activeOctave = activeOctave;
+    reply.activeInst = activeInst;
+  }
+}
+
+void Main::openAudioCapture(const std::string &path, bool probe) {
+  audio.reset(new AudioCapture(h2f, path));
+  latencyProbes = probe;
+  probeFrame = audio->getWritten();
+}
+
+void Main::closeAudioCapture(std::ostream &out) {
+  if (!audio) return;
+  if (probeHeld)
+    keyboard.setMonitor(Layout::DRUM_KEY, 0, false);
+  audio->finish();
+  audio->report(out);
+}
+
+void Main::probeLatency() {
+  uint16_t since = audio->getWritten() - probeFrame;
+  if (!probeHeld && since >= CAPTURE_PROBE_PERIOD) {
+    // Mark after the write, so that the latency includes all of it.
+    keyboard.setMonitor(Layout::DRUM_KEY, 0, true);
+    audio->mark();
+    probeHeld = true;
+    probeFrame = audio->getWritten();
+  } else if (probeHeld && since >= CAPTURE_PROBE_PERIOD / 4) {
+    keyboard.setMonitor(Layout::DRUM_KEY, 0, false);
+    probeHeld = false;
+  }
+}
+
+#ifdef H2F_SIM
+void Main::saveFrame(const std::string &path) const {
+  std::unique_ptr<DisplayState> display(new DisplayState);
+  std::vector<uint8_t> frame(FRAME_WIDTH * FRAME_HEIGHT * 3);
+  h2f.getSimDisplay(*display);
+  FrameRenderer().render(*display, frame.data());
+  FrameRenderer::savePPM(path, frame.data());
+}
+
+void Main::benchmarkFrames(uint32_t frames, std::ostream &out) const {
+  std::unique_ptr<DisplayState> display(new DisplayState);
+  std::vector<uint8_t> frame(FRAME_WIDTH * FRAME_HEIGHT * 3);
+  FrameRenderer renderer;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < frames; ++i) {
+    // Include reading the state, as a display update path would.
+    h2f.getSimDisplay(*display);
+    renderer.render(*display, frame.data());
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  out << frames << " frames in " << elapsed.count() << " s, "
+    << frames / elapsed.count() << " frames/s" << std::endl;
+}
+
+bool Main::checkFrames(const std::string &path, bool update, const std::string &displayPath,
+    std::ostream &out) {
+  // Position, octave, instrument and samples played from there, to
+  // cover the subtile scroll, the drum octave and notes in the keys.
+  const struct { uint32_t pos; uint8_t octave, inst; uint32_t samples; } FRAMES[] = {
+    {0, 1, 0, 0}, {24, 2, 1, 1200}, {34, 3, 2, 4000},
+    {61, Layout::DRUM_OCTAVE, 0, 2500}, {102, 0, 3, 9000}, {250, 2, 5, 7000}
+  };
+  const size_t FRAME_COUNT = sizeof(FRAMES) / sizeof(FRAMES[0]);
+
+  std::vector<uint64_t> golden;
+  if (!update) {
+    std::ifstream file(path);
+    if (!file)
+      throw std::runtime_error("failed to open " + path);
+    std::string line;
+    while (std::getline(file, line))
+      golden.push_back(std::stoull(line, nullptr, 16));
+    if (golden.size() != FRAME_COUNT)
+      throw std::runtime_error(path + ": expected " + std::to_string(FRAME_COUNT) + " checksums");
+  }
+
+  std::ofstream displays;
+  if (!displayPath.empty()) {
+    displays.open(displayPath, std::ios::binary);
+    if (!displays)
+      throw std::runtime_error("failed to write " + displayPath);
+  }
+
+  loadDemoSong();
+  std::unique_ptr<DisplayState> display(new DisplayState);
+  std::vector<uint8_t> frame(FRAME_WIDTH * FRAME_HEIGHT * 3), serial(frame.size());
+  FrameRenderer renderer, single(1);
+  std::vector<uint64_t> sums;
+  bool passed = true;
+  for (size_t i = 0; i < FRAME_COUNT; ++i) {
+    sequencer.seek(FRAMES[i].pos);
+    setOctave(FRAMES[i].octave);
+    setInst(FRAMES[i].inst);
+    sequencer.update(true, false, 0);
+    timeBase += FRAMES[i].samples;
+    sequencer.update(true, false, 0);
+    sequencer.flushTiles();
+    h2f.getSimDisplay(*display);
+    renderer.render(*display, frame.data());
+    single.render(*display, serial.data());
+    if (displays.is_open())
+      displays.write(reinterpret_cast<const char*>(display.get()), sizeof(DisplayState));
+
+    // FNV-1a.
+    uint64_t sum = 0xCBF29CE484222325;
+    for (uint8_t j : frame)
+      sum = (sum ^ j) * 0x100000001B3;
+    sums.push_back(sum);
+    if (frame != serial) {
+      out << "frame " << i << ": rows rendered in parallel differ" << std::endl;
+      passed = false;
+    }
+    if (!update && sum != golden[i]) {
+      out << "frame " << i << " at step " << FRAMES[i].pos << ": checksum " << std::hex << sum
+        << ", expected " << golden[i] << std::dec << std::endl;
+      passed = false;
+    }
+  }
+  sequencer.update(false, false, 0);
+
+  if (update) {
+    std::ofstream file(path);
+    if (!file)
+      throw std::runtime_error("failed to write " + path);
+    for (uint64_t i : sums)
+      file << std::hex << std::setw(16) << std::setfill('0') << i << std::endl;
+    out << FRAME_COUNT << " checksums written to " << path << std::endl;
+  } else if (passed) {
+    out << FRAME_COUNT << " frames match " << path << std::endl;
+  }
+  if (displays.is_open() && !displays.flush())
+    throw std::runtime_error("failed to write " + displayPath);
+  return passed;
+}
+#endif
+
+void Main::publishStatus() {
+  StatusData &data = status->begin();
+  sequencer.getStatus(data);
+  keyboard.getStatus(data);
+  data.timeBase = timeBase;
+  data.activeOctave = activeOctave;
+  data.activeInst = activeInst;
+  if (data.isPlaying) ++boundaries;
+  data.iterations = iterations;
+  data.boundaries = boundaries;
+  data.maxIterationSamples = maxIterationSamples;
+  data.boundaryLateness = data.isPlaying ? timeBase - data.lastBoundary : 0;
+  status->end();
+  maxIterationSamples = 0;
+  lastPublish = timeBase;
+}
+
+void Main::loadSongFile(const std::string &path) {
+  SongFile song;
+  song.load(path);
+  for (const Note &i : song.notes)
+    sequencer.addNote(i);
+  if (song.loopEnd)
+    sequencer.setLoop(song.loopStart, song.loopEnd);
+  sequencer.setTempo(song.tempo);
+  songWatcher.reset(new SongWatcher(path, song));
+  analyzeSong(false);
+}
+
+void Main::openSetlist(const std::string &path) {
+  setlist.reset(new Setlist(path));
+  switchSong();
+}
+
+void Main::analyzeSong(bool warningsOnly) {
+  SongAnalysis analysis;
+  sequencer.analyze(analysis);
+  if (!warningsOnly || analysis.hasWarnings())
+    analysis.report(std::cout);
 }
 
 int main(int argc, char *argv[]) {
+  // Stop on Ctrl-C so that the capture gets saved and the status
+  // page gets removed.
+  std::signal(SIGINT, onStopSignal);
+  std::signal(SIGTERM, onStopSignal);
   try {
-    Main inst;
-    if (argc == 2) {
-      std::string arg(argv[1]);
-      if (arg == "drum")
+    if (argc == 3 && std::string(argv[1]) == "-g") {
+      Tables::generate(argv[2]);
+      return 0;
+    }
+    if (argc == 5 && std::string(argv[1]) == "-b") {
+      ControlClient(argv[2]).benchmark(std::stoul(argv[3]), std::stoul(argv[4]), std::cout);
+      return 0;
+    }
+#ifdef H2F_SIM
+    if (argc >= 3 && std::string(argv[1]) == "-t") {
+      ViewChecker checker(argc > 3 ? std::stoul(argv[3]) : 1);
+      return checker.run(std::stoul(argv[2]), std::cout) ? 0 : 1;
+    }
+    if (argc >= 3 && std::string(argv[1]) == "-G") {
+      Main inst;
+      bool update = argc > 3 && std::string(argv[3]) == "update";
+      std::string displayPath = argc > 3 && !update ? argv[3] : "";
+      return inst.checkFrames(argv[2], update, displayPath, std::cout) ? 0 : 1;
+    }
+#endif
+
+    // Capture options come first, as the traffic of the setup is
+    // captured too. A replay needs the same remaining arguments.
+    std::unique_ptr<Capture> capture;
+    std::string capturePath;
+    int i = 1;
+    if (i + 1 < argc && std::string(argv[i]) == "-c") {
+      capturePath = argv[i + 1];
+      capture.reset(new Capture(22));
+      i += 2;
+    } else if (i + 1 < argc && std::string(argv[i]) == "-r") {
+      capture.reset(new Capture(std::string(argv[i + 1])));
+      i += 2;
+    }
+
+    Main inst(capture.get());
+#ifdef H2F_SIM
+    std::string framePath;
+    uint32_t benchFrames = 0;
+#endif
+    for (; i < argc; ++i) {
+      std::string arg(argv[i]);
+      if (arg == "-n")
+        inst.setNoteDisplay(true);
+      else if (arg == "-e")
+        inst.setEventMode(true);
+      else if (arg == "-s" && i + 1 < argc)
+        inst.openStatusPage(argv[++i]);
+      else if (arg == "-m" && i + 1 < argc)
+        inst.openMidiInput(argv[++i]);
+      else if (arg == "-l" && i + 1 < argc)
+        inst.openSetlist(argv[++i]);
+      else if (arg == "-k" && i + 1 < argc)
+        inst.openControlSocket(argv[++i]);
+      else if ((arg == "-a" || arg == "-L") && i + 1 < argc)
+        inst.openAudioCapture(argv[++i], arg == "-L");
+#ifdef H2F_SIM
+      else if (arg == "-p" && i + 1 < argc)
+        framePath = argv[++i];
+      else if (arg == "-f" && i + 1 < argc)
+        benchFrames = std::stoul(argv[++i]);
+#endif
+      else if (arg == "drum")
         inst.loadDrumLoop();
       else if (arg == "demo")
         inst.loadDemoSong();
+      else
+        inst.loadSongFile(arg);
     }
     inst.run();
+    inst.reportMidiInput(std::cout);
+    inst.closeAudioCapture(std::cout);
+#ifdef H2F_SIM
+    // The display at the end of the run, e.g. of a replayed capture.
+    if (!framePath.empty())
+      inst.saveFrame(framePath);
+    if (benchFrames)
+      inst.benchmarkFrames(benchFrames, std::cout);
+#endif
+
+    if (capture && capture->isReplaying())
+      capture->report(std::cout);
+    else if (capture)
+      capture->save(capturePath);
   } catch (std::exception &x) {
     std::cout << "error: " << x.what() << std::endl;
   }
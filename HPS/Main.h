@@ -1,36 +1,117 @@
 #ifndef _MAIN_H_
 #define _MAIN_H_
+#include "AudioCapture.h"
+#include "ControlServer.h"
 #include "H2F.h"
 #include "Keyboard.h"
+#include "MidiInput.h"
 #include "Buttons.h"
 #include "Sequencer.h"
+#include "Setlist.h"
+#include "SongWatcher.h"
+#include "StatusPage.h"
 
 // Main class: manages top-level states.
 // Author: Yibo Cao
 
 class Main {
+  friend class ViewChecker;
   H2F h2f;
   Buttons buttons;
   Keyboard keyboard;
   Sequencer sequencer;
+  std::unique_ptr<SongWatcher> songWatcher;
+  // Diff of the song file being applied or handed back.
+  std::unique_ptr<SongDiff> songDiff;
+  std::unique_ptr<Setlist> setlist;
+  std::unique_ptr<StatusPublisher> status;
+  std::unique_ptr<MidiInput> midi;
+  std::unique_ptr<AudioCapture> audio;
+  std::unique_ptr<ControlServer> control;
+  // Batches being applied or handed back, the note edits of all of them
+  // in command order, and those edits as one diff. Reused so that
+  // applying them rarely allocates.
+  struct ControlEdit {
+    Note note;
+    uint32_t order;
+    bool add;
+  };
+  std::vector<ControlBatch> controlBatches;
+  std::vector<ControlEdit> controlEdits;
+  SongDiff controlDiff;
+  // Instrument + 1 held by each note of the tonal and the drum channels
+  // of the MIDI input, and the held keys in the recording range.
+  uint8_t midiHeld[2][128];
+  uint16_t midiInputs;
+  uint64_t iterations, boundaries;
+  uint32_t maxIterationSamples, lastPublish;
   uint32_t timeBase;
-  uint16_t keyInputs;
+  uint16_t sampleOffset, keyInputs;
+  bool wasRecording, songRequested;
+  // Playback follows the play switch, or a control command given since
+  // the switch last moved.
+  bool playSwitch, playing;
+  // Loopback latency probes: a kick is held for a quarter of the period,
+  // from the frame of the last probe.
+  bool latencyProbes, probeHeld;
+  uint16_t probeFrame;
   uint8_t activeOctave, activeInst;
   void setOctave(uint8_t which);
   void setInst(uint8_t which);
   void onKeyInputChange(uint8_t key, bool on);
   void onKeyInputChange(uint8_t pitch, uint8_t inst, bool on);
+  void onMidiEvent(const MidiEvent &event);
+  void updateMidiInputs();
+  void publishStatus();
+  void probeLatency();
+  // Applies the batches of the control socket, see ControlServer.h.
+  void applyControl();
+  // Swaps in the next song of the setlist, if it's ready.
+  bool switchSong();
+  // Prints what the song asks of the FPGA, see SongAnalysis.h.
+  void analyzeSong(bool warningsOnly);
 public:
-  Main();
+  explicit Main(Capture *capture = nullptr);
   void loadDemoSong();
   void loadDrumLoop();
+  void loadSongFile(const std::string &path);
+  // Plays the songs of a setlist file, see Setlist.h.
+  void openSetlist(const std::string &path);
+  void setNoteDisplay(bool on) { sequencer.setNoteDisplay(on); }
+  void setEventMode(bool on) { keyboard.setEventMode(on); }
+  // Publishes the status to a shared memory page, see StatusPage.h.
+  void openStatusPage(const std::string &name);
+  // Plays and records notes from a MIDI device or FIFO.
+  void openMidiInput(const std::string &path);
+  void reportMidiInput(std::ostream &out) const;
+  // Records the synthesized output and the codec input to WAV files,
+  // see AudioCapture.h, optionally probing the loopback latency.
+  void openAudioCapture(const std::string &path, bool probe);
+  void closeAudioCapture(std::ostream &out);
+  // Accepts batches of commands on a Unix domain socket.
+  void openControlSocket(const std::string &path);
+#ifdef H2F_SIM
+  // Renders the display as graph_main would, see FrameRenderer.h.
+  void saveFrame(const std::string &path) const;
+  void benchmarkFrames(uint32_t frames, std::ostream &out) const;
+  // Renders the demo song at fixed positions and compares the checksums
+  // of the frames with those in a golden file, or writes them there.
+  // With a display path, also writes the DisplayState of each frame
+  // there, for the RTL harness FPGA/sim/graph_frame.cpp.
+  bool checkFrames(const std::string &path, bool update, const std::string &displayPath,
+    std::ostream &out);
+#endif
   void addDemoNote(uint32_t startTime, uint32_t duration,
     uint8_t pitch, uint8_t inst);
   void run();
   uint32_t getTimeBase() const { return timeBase; }
+  // Value of the FPGA sample counter at a time base.
+  uint16_t getSampleCount(uint32_t time) const { return (time + sampleOffset) & 0x3FFF; }
   void shiftOctave(bool positive);
   void shiftInst(bool positive);
   void scrollScreen(bool positive);
+  // Switches to the next song of the setlist at the next boundary.
+  void nextSong();
   uint8_t getOctave() const { return activeOctave; }
   uint8_t getInst() const { return activeInst; }
 };
@@ -0,0 +1,160 @@
+#include <cerrno>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include "MidiInput.h"
+
+uint64_t midiClock() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+MidiInput::MidiInput(const std::string &path)
+    :path(path), device(open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC)),
+    keepOpen(-1), poller(epoll_create1(EPOLL_CLOEXEC)), wakeRead(-1), wakeWrite(-1),
+    status(0), dataCount(0), data(), queue(), head(0), tail(0), dropped(0),
+    applied(0), totalLatency(0), maxLatency(0), lateEvents(0) {
+  if (device.fd < 0)
+    throw std::runtime_error("failed to open " + path);
+  if (poller.fd < 0)
+    throw std::runtime_error("failed to create epoll");
+
+  // A FIFO reports a hangup whenever its last writer closes. Hold it
+  // open for writing too, so that test scripts can come and go.
+  struct stat info;
+  if (fstat(device.fd, &info) == 0 && S_ISFIFO(info.st_mode)) {
+    keepOpen.fd = open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (keepOpen.fd < 0)
+      throw std::runtime_error("failed to hold " + path + " open");
+  }
+
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) < 0)
+    throw std::runtime_error("failed to create pipe");
+  wakeRead.fd = fds[0];
+  wakeWrite.fd = fds[1];
+
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = device.fd;
+  if (epoll_ctl(poller.fd, EPOLL_CTL_ADD, device.fd, &event) < 0)
+    throw std::runtime_error("failed to watch " + path);
+  event.data.fd = wakeRead.fd;
+  if (epoll_ctl(poller.fd, EPOLL_CTL_ADD, wakeRead.fd, &event) < 0)
+    throw std::runtime_error("failed to watch pipe");
+  thread = std::thread(&MidiInput::threadMain, this);
+}
+
+MidiInput::~MidiInput() {
+  char dummy = 0;
+  if (write(wakeWrite.fd, &dummy, 1) == 1)
+    thread.join();
+  else
+    thread.detach();
+}
+
+void MidiInput::threadMain() {
+  uint8_t buffer[256];
+  for (;;) {
+    epoll_event events[2];
+    int count = epoll_wait(poller.fd, events, 2, -1);
+    if (count < 0)
+      continue;
+    uint64_t arrival = midiClock();
+    bool readable = false;
+    for (int i = 0; i < count; ++i) {
+      if (events[i].data.fd == wakeRead.fd)
+        return;
+      readable = true;
+    }
+    if (!readable)
+      continue;
+
+    // Drain everything that has arrived, since epoll only wakes again
+    // for new bytes.
+    for (;;) {
+      ssize_t size = read(device.fd, buffer, sizeof(buffer));
+      if (size > 0) {
+        for (ssize_t i = 0; i < size; ++i)
+          parse(buffer[i], arrival);
+      } else if (size < 0 && errno == EINTR) {
+        continue;
+      } else if (size < 0 && errno == EAGAIN) {
+        break;
+      } else {
+        std::cout << "MIDI input " << path << " closed" << std::endl;
+        return;
+      }
+    }
+  }
+}
+
+void MidiInput::parse(uint8_t byte, uint64_t arrival) {
+  // Real-time messages may appear anywhere, even inside other messages.
+  if (byte >= 0xF8)
+    return;
+  if (byte & 0x80) {
+    // System messages cancel the running status, and their data bytes
+    // are skipped since the status is cleared.
+    status = byte < 0xF0 ? byte : 0;
+    dataCount = 0;
+    return;
+  }
+  if (!status)
+    return;
+
+  // Data byte of the running status.
+  data[dataCount++] = byte;
+  uint8_t type = status & 0xF0;
+  if (dataCount < (type == 0xC0 || type == 0xD0 ? 1 : 2))
+    return;
+  dataCount = 0;
+  if (type == 0x80 || type == 0x90) {
+    MidiEvent event;
+    event.arrival = arrival;
+    event.channel = status & 0x0F;
+    event.note = data[0];
+    // A note-on with zero velocity is a note-off.
+    event.on = type == 0x90 && data[1];
+    push(event);
+  }
+}
+
+void MidiInput::push(const MidiEvent &event) {
+  uint32_t at = tail.load(std::memory_order_relaxed);
+  if (at - head.load(std::memory_order_acquire) == MIDI_QUEUE_SIZE) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  queue[at % MIDI_QUEUE_SIZE] = event;
+  tail.store(at + 1, std::memory_order_release);
+}
+
+bool MidiInput::poll(MidiEvent &out) {
+  uint32_t at = head.load(std::memory_order_relaxed);
+  if (at == tail.load(std::memory_order_acquire))
+    return false;
+  out = queue[at % MIDI_QUEUE_SIZE];
+  head.store(at + 1, std::memory_order_release);
+  return true;
+}
+
+void MidiInput::onApplied(const MidiEvent &event) {
+  uint64_t latency = midiClock() - event.arrival;
+  ++applied;
+  totalLatency += latency;
+  if (latency > maxLatency) maxLatency = latency;
+  if (latency >= 1000000) ++lateEvents;
+}
+
+void MidiInput::report(std::ostream &out) const {
+  out << "MIDI: " << applied << " events";
+  if (applied)
+    out << ", latency mean " << totalLatency / applied / 1000.0
+      << " us, max " << maxLatency / 1000.0 << " us, " << lateEvents << " over 1 ms";
+  out << ", " << dropped.load() << " dropped" << std::endl;
+}
@@ -0,0 +1,63 @@
+#ifndef _MIDI_INPUT_H_
+#define _MIDI_INPUT_H_
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <thread>
+#include "FDGuard.h"
+
+// MidiInput: reads raw MIDI bytes from a character device or a named
+//   FIFO. A background thread sleeps in epoll until bytes arrive, parses
+//   note-ons and note-offs with running status, and passes them to the
+//   real-time loop through a lock-free queue, so that the loop only has
+//   to check an index per iteration.
+
+#define MIDI_QUEUE_SIZE 256
+// The MIDI note played by pitch 0, and by the first drum.
+#define MIDI_BASE_NOTE  48
+#define MIDI_DRUM_NOTE  36
+// Channel 10, the drum channel of General MIDI.
+#define MIDI_DRUM_CHANNEL 9
+
+struct MidiEvent {
+  // CLOCK_MONOTONIC time of the arrival of the last byte, in ns.
+  uint64_t arrival;
+  uint8_t channel, note;
+  bool on;
+};
+
+class MidiInput {
+  std::string path;
+  FDGuard device, keepOpen, poller, wakeRead, wakeWrite;
+
+  // Parser state, only accessed by the background thread.
+  uint8_t status, dataCount, data[2];
+
+  // Single producer, single consumer queue.
+  MidiEvent queue[MIDI_QUEUE_SIZE];
+  std::atomic<uint32_t> head, tail;
+  std::atomic<uint32_t> dropped;
+
+  // Latency from arrival to the key state write, only accessed by the
+  // real-time loop.
+  uint64_t applied, totalLatency, maxLatency, lateEvents;
+
+  std::thread thread;
+  void threadMain();
+  void parse(uint8_t byte, uint64_t arrival);
+  void push(const MidiEvent &event);
+public:
+  explicit MidiInput(const std::string &path);
+  ~MidiInput();
+  // Takes the oldest event if there is one. Never blocks.
+  bool poll(MidiEvent &out);
+  // Records the latency of an event after it has been applied.
+  void onApplied(const MidiEvent &event);
+  void report(std::ostream &out) const;
+};
+
+// Monotonic time in ns, as used for the arrival times.
+uint64_t midiClock();
+
+#endif
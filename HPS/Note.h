@@ -19,6 +19,8 @@ struct Note {
   uint32_t startTime, duration;
   uint8_t pitch, inst;
   bool isInView;
+  // Slot in the note list display, or -1.
+  int16_t slot;
   ItrList itrList;
   ItrSetS itrSetS;
   ItrSetE itrSetE;
@@ -0,0 +1,47 @@
+#include "NoteRaster.h"
+
+void rasterizeTrack(const NoteSlot *slots, uint16_t count,
+    uint16_t viewPos, uint8_t pitch, uint32_t out[64]) {
+  for (uint8_t i = 0; i < 64; ++i)
+    out[i] = 0;
+  for (uint16_t i = 0; i < count; ++i) {
+    const NoteSlot &slot = slots[i];
+    if (!slot.valid || slot.pitch != pitch)
+      continue;
+    int16_t relStart = static_cast<int16_t>(slot.start - viewPos);
+    int16_t relEnd = static_cast<int16_t>(slot.end - viewPos);
+    uint32_t mask = static_cast<uint32_t>(7) << (slot.inst * 3);
+    for (int16_t j = 0; j < 64; ++j) {
+      if (relStart > j || relEnd < j)
+        continue;
+      uint32_t state = 1;
+      if (relStart == j) state |= 2;
+      if (relEnd == j) state |= 4;
+      out[j] = (out[j] & ~mask) | state << (slot.inst * 3);
+    }
+  }
+}
+
+#ifdef NOTE_RASTER_DPI
+
+// DPI-C functions used by graph_notes_testbench.
+static NoteSlot dpiSlots[256];
+
+extern "C" void note_raster_reset() {
+  for (NoteSlot &i : dpiSlots)
+    i.valid = false;
+}
+
+extern "C" void note_raster_set(int slot, int start, int end,
+    int pitch, int inst, int valid) {
+  dpiSlots[slot & 255] = {static_cast<uint16_t>(start), static_cast<uint16_t>(end),
+    static_cast<uint8_t>(pitch), static_cast<uint8_t>(inst), valid != 0};
+}
+
+extern "C" int note_raster_tile(int viewPos, int pitch, int tile) {
+  uint32_t out[64];
+  rasterizeTrack(dpiSlots, 256, viewPos, pitch, out);
+  return out[tile & 63];
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _NOTE_RASTER_H_
+#define _NOTE_RASTER_H_
+#include <cstdint>
+
+// NoteRaster: reference model of the note renderer in graph_notes.sv.
+// Positions are 16-bit and wrap around like in the hardware.
+
+struct NoteSlot {
+  uint16_t start, end;
+  uint8_t pitch, inst;
+  bool valid;
+};
+
+// Computes the tile states of a track, in the same layout as the tile
+// memory. Later slots overwrite earlier ones where they overlap.
+void rasterizeTrack(const NoteSlot *slots, uint16_t count,
+  uint16_t viewPos, uint8_t pitch, uint32_t out[64]);
+
+#endif
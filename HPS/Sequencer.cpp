@@ -1,13 +1,20 @@
+#include <algorithm>
+#include <iostream>
 #include "Sequencer.h"
 #include "Main.h"
+#include "Setlist.h"
 
 Sequencer::Sequencer(H2F &h2f, Keyboard &keyboard, Main &main)
-    :main(main), keyboard(keyboard), h2f(h2f), isPlaying(),
-    tileStates(), tilePos(0), tileOffset(0) {
+    :main(main), keyboard(keyboard), h2f(h2f), isPlaying(), lastBoundary(0), nextScheduled(), nextDropped(),
+    tempoOrigin(0), stepLength(SAMPLES_PER_16TH), scrollScale(0), tileStates(), dirtyRows(), recordingNotes(), tilePos(0), tileOffset(0),
+    noteDisplay(), loopStart(0), loopEnd(0), loopKeys(), loopKeysValid() {
   h2f.setSubtileScroll(0);
   writeScrollRegs();
-  for (uint16_t i = 0; i < 49 * 64; ++i)
-    h2f.setTileState(i, 0);
+  // Clear all tiles on the first flush.
+  for (uint8_t i = 0; i < Layout::ROWS; ++i) {
+    markDirty(Layout::tileAddr(i, 0));
+    markDirty(Layout::tileAddr(i, Layout::KEYS - 1));
+  }
 }
 
 bool Sequencer::shouldLockView() const {
@@ -15,17 +22,56 @@ bool Sequencer::shouldLockView() const {
 }
 
 void Sequencer::writeScrollRegs() {
-  h2f.setGridScroll(tilePos + 8);
-  h2f.setTileOffset(tileOffset);
+  if (noteDisplay) {
+    h2f.setViewPos(tilePos - Layout::ROWS_BELOW);
+  } else {
+    h2f.setGridScroll(tilePos + Layout::ROWS_BELOW);
+    h2f.setTileOffset(tileOffset);
+  }
 }
 
 void Sequencer::setTileState(uint8_t row, uint8_t pitch, uint8_t inst, uint8_t state) {
-  uint16_t addr = static_cast<uint16_t>((row + tileOffset) & 63) * 49 + pitch;
-  uint32_t mask = static_cast<uint32_t>(7) << (inst * 3);
-  uint32_t &data = tileStates[addr];
-  data &= ~mask;
-  data |= static_cast<uint32_t>(state & 7) << (inst * 3);
-  h2f.setTileState(addr, data);
+  uint16_t addr = Layout::tileAddr(row + tileOffset, pitch);
+  TileState stateMask = (static_cast<TileState>(1) << Layout::TILE_BITS) - 1;
+  TileState &data = tileStates[addr];
+  data &= ~(stateMask << (inst * Layout::TILE_BITS));
+  data |= (state & stateMask) << (inst * Layout::TILE_BITS);
+  markDirty(addr);
+}
+
+void Sequencer::markDirty(uint16_t addr) {
+  uint8_t row = addr / Layout::KEYS, pitch = addr % Layout::KEYS;
+  uint64_t bit = static_cast<uint64_t>(1) << row;
+  if (dirtyRows & bit) {
+    dirtyLo[row] = std::min(dirtyLo[row], pitch);
+    dirtyHi[row] = std::max(dirtyHi[row], pitch);
+  } else {
+    dirtyRows |= bit;
+    dirtyLo[row] = dirtyHi[row] = pitch;
+  }
+}
+
+void Sequencer::flushTiles() {
+  if (noteDisplay) {
+    // Tiles are still maintained, but only written when switching back.
+    dirtyRows = 0;
+    return;
+  }
+  while (dirtyRows) {
+    uint8_t row = __builtin_ctzll(dirtyRows);
+    uint16_t start = Layout::tileAddr(row, dirtyLo[row]);
+    uint16_t end = Layout::tileAddr(row, dirtyHi[row]) + 1;
+    dirtyRows &= dirtyRows - 1;
+    // Merge with the following rows while the ranges are contiguous.
+    while (end % Layout::KEYS == 0 && end < Layout::TILES) {
+      uint8_t next = end / Layout::KEYS;
+      if (!(dirtyRows & static_cast<uint64_t>(1) << next) || dirtyLo[next])
+        break;
+      end = Layout::tileAddr(next, dirtyHi[next]) + 1;
+      dirtyRows &= ~(static_cast<uint64_t>(1) << next);
+    }
+    h2f.writeTiles(start, tileStates + start, end - start);
+  }
 }
 
 void Sequencer::addToView(Note *note) {
@@ -33,21 +79,77 @@ void Sequencer::addToView(Note *note) {
   note->isInView = true;
   view.push_front(note);
   note->itrView = view.begin();
+  if (noteDisplay)
+    uploadNote(note);
+}
+
+Note::ItrView Sequencer::removeFromView(Note *note) {
+  note->isInView = false;
+  if (note->slot >= 0) {
+    h2f.clearNoteSlot(note->slot);
+    freeSlots.push_back(note->slot);
+    note->slot = -1;
+  }
+  return view.erase(note->itrView);
+}
+
+void Sequencer::uploadNote(Note *note) {
+  if (freeSlots.empty()) {
+    std::cout << "too many visible notes, switching to tile display" << std::endl;
+    setNoteDisplay(false);
+    return;
+  }
+  note->slot = freeSlots.back();
+  freeSlots.pop_back();
+  h2f.setNoteSlot(note->slot, note->startTime, note->endTime(),
+    note->pitch, note->inst);
+}
+
+void Sequencer::setNoteDisplay(bool on) {
+  if (on == noteDisplay) return;
+  if (on) {
+    // Clear the whole list, then upload the notes in view.
+    noteDisplay = true;
+    freeSlots.clear();
+    for (uint16_t i = 256; i--; ) {
+      h2f.clearNoteSlot(i);
+      freeSlots.push_back(i);
+    }
+    for (Note *note : view) {
+      uploadNote(note);
+      if (!noteDisplay) return;
+    }
+    writeScrollRegs();
+    h2f.setNoteDisplay(true);
+  } else {
+    noteDisplay = false;
+    for (Note *note : view)
+      note->slot = -1;
+    writeScrollRegs();
+    // Rewrite all tiles, as they weren't written in note display mode.
+    for (uint8_t i = 0; i < Layout::ROWS; ++i) {
+      markDirty(Layout::tileAddr(i, 0));
+      markDirty(Layout::tileAddr(i, Layout::KEYS - 1));
+    }
+    flushTiles();
+    h2f.setNoteDisplay(false);
+  }
 }
 
 bool Sequencer::drawCompleteNote(Note *note, bool remove) {
   // How the note intersects the view.
-  bool startPastBottom = tilePos < 8 || note->startTime >= tilePos - 8;
-  bool startWithinTop = note->startTime <= tilePos + 55;
-  bool endPastBottom = tilePos < 8 || note->endTime() >= tilePos - 8;
-  bool endWithinTop = note->endTime() <= tilePos + 55;
+  const uint32_t below = Layout::ROWS_BELOW, above = Layout::ROWS_ABOVE;
+  bool startPastBottom = tilePos < below || note->startTime >= tilePos - below;
+  bool startWithinTop = note->startTime <= tilePos + above;
+  bool endPastBottom = tilePos < below || note->endTime() >= tilePos - below;
+  bool endWithinTop = note->endTime() <= tilePos + above;
 
   if (!startWithinTop || !endPastBottom) {
     // Out of screen.
     return false;
   } else {
-    uint32_t rowStart = note->startTime - tilePos + 8;
-    uint32_t rowEnd = note->endTime() - tilePos + 8;
+    uint32_t rowStart = note->startTime - tilePos + below;
+    uint32_t rowEnd = note->endTime() - tilePos + below;
     bool hasTopBorder = true, hasBottomBorder = true;
     if (startPastBottom) {
       if (endWithinTop) {
@@ -55,7 +157,7 @@ bool Sequencer::drawCompleteNote(Note *note, bool remove) {
       } else {
         // Note intersects top line.
         hasTopBorder = false;
-        rowEnd = 55;
+        rowEnd = Layout::ROWS - 1;
       }
     } else if (endWithinTop) {
       // Note intersects bottom line.
@@ -66,7 +168,7 @@ bool Sequencer::drawCompleteNote(Note *note, bool remove) {
       hasTopBorder = false;
       hasBottomBorder = false;
       rowStart = 0;
-      rowEnd = 55;
+      rowEnd = Layout::ROWS - 1;
     }
     for (uint32_t i = rowStart; i <= rowEnd; ++i) {
       uint8_t state;
@@ -91,28 +193,35 @@ Note *Sequencer::addNote(const Note &params) {
   note->itrList = notes.begin();
   note->itrSetS = noteStarts.insert(note);
   note->itrSetE = noteEnds.insert(note);
+  if (note->duration > LONG_NOTE_STEPS)
+    longNotes.insert(note);
   note->isInView = false;
+  note->slot = -1;
   if (drawCompleteNote(note, false))
     addToView(note);
+  invalidateLoopKeys(note);
   return note;
 }
 
 Note::ItrView Sequencer::removeNote(Note *note) {
   Note::ItrView result;
   drawCompleteNote(note, true);
+  invalidateLoopKeys(note);
   if (note->isInView)
-    result = view.erase(note->itrView);
+    result = removeFromView(note);
   noteStarts.erase(note->itrSetS);
   noteEnds.erase(note->itrSetE);
+  if (note->duration > LONG_NOTE_STEPS)
+    longNotes.erase(note);
   notes.erase(note->itrList);
   return result;
 }
 
-void Sequencer::writeRecordedNotes() {
+void Sequencer::writeRecordedNotes(uint32_t step) {
   // Remove existing notes in the recording region.
   for (auto i = view.begin(); i != view.end();) {
     Note *note = *i;
-    if (note->startTime <= tilePos + 1 && note->endTime() >= tilePos + 1
+    if (note->startTime <= step && note->endTime() >= step
         && isNoteInRecordingRange(note)) {
       keyboard.setSequencer(note->pitch, note->inst, false);
       i = removeNote(note);
@@ -121,8 +230,8 @@ void Sequencer::writeRecordedNotes() {
     }
   }
 
-  bool isDrum = main.getOctave() == 4;
-  for (uint8_t i = 0; i < (isDrum ? 8 : 12); ++i) {
+  bool isDrum = main.getOctave() == Layout::DRUM_OCTAVE;
+  for (uint8_t i = 0; i < (isDrum ? Layout::DRUM_KEYS : Layout::KEYS_PER_OCTAVE); ++i) {
     Note *&note = recordingNotes[i];
     bool pressed = everPressed & (1 << i);
     bool released = everReleased & (1 << i);
@@ -144,9 +253,9 @@ void Sequencer::writeRecordedNotes() {
     } else if (pressed) newNote: {
       // New note is pressed.
       Note params;
-      params.startTime = tilePos + 1;
+      params.startTime = step;
       params.duration = 1;
-      params.pitch = isDrum ? 48 : i + 12 * main.getOctave();
+      params.pitch = isDrum ? Layout::DRUM_KEY : i + Layout::KEYS_PER_OCTAVE * main.getOctave();
       params.inst = isDrum ? i : main.getInst();
       note = addNote(params);
       if (!current) {
@@ -160,34 +269,48 @@ void Sequencer::writeRecordedNotes() {
 void Sequencer::scroll(bool positive) {
   if (!positive && !tilePos)
     return;
+  scrollStep(positive);
+  if (isPlaying)
+    timeStep(true);
+  if (isPlaying && keyboard.isEventMode())
+    resyncKeys();
+}
+
+void Sequencer::scrollStep(bool positive) {
+  // In event mode, key changes are scheduled separately.
+  bool playKeys = isPlaying && !keyboard.isEventMode();
   if (isPlaying) {
-    if (positive) playNotesEnd();
-    else keyboard.clearSequencer();
-    if (isRecording) writeRecordedNotes();
+    if (playKeys) {
+      if (positive) playNotesEnd(tilePos);
+      else keyboard.clearSequencer();
+    }
+    if (isRecording) writeRecordedNotes(tilePos + 1);
   }
 
+  const uint32_t below = Layout::ROWS_BELOW, above = Layout::ROWS_ABOVE;
+  const uint8_t top = Layout::ROWS - 1;
+
   // Remove notes that move out of view.
   for (auto i = view.begin(); i != view.end(); ) {
     Note *note = *i;
     bool shouldErase = false;
     if (!positive) {
       // Rise out of view.
-      if (note->startTime <= tilePos + 55
-          && note->endTime() >= tilePos + 55) {
-        setTileState(63, note->pitch, note->inst, 0);
-        shouldErase = note->startTime == tilePos + 55;
+      if (note->startTime <= tilePos + above
+          && note->endTime() >= tilePos + above) {
+        setTileState(top, note->pitch, note->inst, 0);
+        shouldErase = note->startTime == tilePos + above;
       }
-    } else if (tilePos >= 8) {
+    } else if (tilePos >= below) {
       // Fall out of view.
-      if (tilePos >= 8 && note->startTime <= tilePos - 8
-          && note->endTime() >= tilePos - 8) {
+      if (tilePos >= below && note->startTime <= tilePos - below
+          && note->endTime() >= tilePos - below) {
         setTileState(0, note->pitch, note->inst, 0);
-        shouldErase = note->endTime() == tilePos - 8;
+        shouldErase = note->endTime() == tilePos - below;
       }
     }
     if (shouldErase) {
-      i = view.erase(note->itrView);
-      note->isInView = false;
+      i = removeFromView(note);
     } else {
       ++i;
     }
@@ -207,15 +330,15 @@ void Sequencer::scroll(bool positive) {
   for (Note *note : view) {
     if (positive) {
       // Fall into view.
-      if (note->endTime() > tilePos + 55)
-        setTileState(63, note->pitch, note->inst, 1);
-      else if (note->endTime() == tilePos + 55)
-        setTileState(63, note->pitch, note->inst, 5);
-    } else if (tilePos >= 8) {
+      if (note->endTime() > tilePos + above)
+        setTileState(top, note->pitch, note->inst, 1);
+      else if (note->endTime() == tilePos + above)
+        setTileState(top, note->pitch, note->inst, 5);
+    } else if (tilePos >= below) {
       // Rise into view.
-      if (note->startTime < tilePos - 8)
+      if (note->startTime < tilePos - below)
         setTileState(0, note->pitch, note->inst, 1);
-      else if (note->startTime == tilePos - 8)
+      else if (note->startTime == tilePos - below)
         setTileState(0, note->pitch, note->inst, 3);
     }
   }
@@ -224,18 +347,18 @@ void Sequencer::scroll(bool positive) {
   if (positive) {
     // Fall into view.
     Note target;
-    target.startTime = tilePos + 55;
+    target.startTime = tilePos + above;
     auto range = noteStarts.equal_range(&target);
     for (auto i = range.first; i != range.second; ++i) {
       Note *note = *i;
       addToView(note);
-      setTileState(63, note->pitch, note->inst,
+      setTileState(top, note->pitch, note->inst,
         note->duration == 1 ? 7 : 3);
     }
-  } else if (tilePos >= 8) {
+  } else if (tilePos >= below) {
     // Rise into view.
     Note target;
-    target.startTime = tilePos - 8;
+    target.startTime = tilePos - below;
     target.duration = 1;
     auto range = noteEnds.equal_range(&target);
     for (auto i = range.first; i != range.second; ++i) {
@@ -246,11 +369,12 @@ void Sequencer::scroll(bool positive) {
     }
   }
 
-  if (positive && isPlaying)
-    playNotesStart();
+  if (positive && playKeys)
+    playNotesStart(tilePos);
 }
 
-void Sequencer::update(bool play, bool record, uint16_t keyStates) {
+bool Sequencer::update(bool play, bool record, uint16_t keyStates) {
+  bool atBoundary = true;
   if (play) {
     // State updates for recording.
     if ((!isPlaying || !isRecording) && record) {
@@ -265,29 +389,106 @@ void Sequencer::update(bool play, bool record, uint16_t keyStates) {
     everReleased |= ~keyStates;
 
     // Update scrolling and playback.
+    setEventTime(main.getTimeBase());
     if (!isPlaying) {
       lastBoundary = main.getTimeBase();
-      playNotesStart();
+      timeStep(true);
+      playNotesStart(tilePos);
+      if (keyboard.isEventMode())
+        scheduleNextStep();
     }
     uint32_t elapsed = main.getTimeBase() - lastBoundary;
-    while (elapsed >= SAMPLES_PER_16TH) {
-      elapsed -= SAMPLES_PER_16TH;
-      lastBoundary += SAMPLES_PER_16TH;
-      scroll(true);
+    atBoundary = !isPlaying || elapsed >= stepLength;
+    while (elapsed >= stepLength) {
+      // Late rather than never, should the loop stall past a boundary.
+      nextDropped = false;
+      if (keyboard.isEventMode() && !nextScheduled)
+        scheduleNextStep();
+      elapsed -= stepLength;
+      lastBoundary += stepLength;
+      if (loopEnd && tilePos + 1 == loopEnd) {
+        wrapLoop();
+      } else {
+        scrollStep(true);
+        timeStep(false);
+        // Prepare the key states before reaching the end of the loop.
+        if (loopEnd && tilePos + 1 == loopEnd && !loopKeysValid)
+          computeLoopKeys();
+      }
+      if (keyboard.isEventMode())
+        scheduleNextStep();
       everPressed = 0;
       everReleased = 0;
     }
-    h2f.setSubtileScroll(elapsed * 15 / SAMPLES_PER_16TH);
+    if (keyboard.isEventMode() && !nextScheduled)
+      scheduleNextStep();
+    h2f.setSubtileScroll(std::min<uint64_t>(elapsed * scrollScale >> 32, 14));
   } else if (isPlaying) {
     h2f.setSubtileScroll(0);
     keyboard.clearSequencer();
   }
   isPlaying = play;
+  return atBoundary;
+}
+
+void Sequencer::onRecordKey(uint8_t key, bool on) {
+  if (on) everPressed |= 1 << key;
+  else everReleased |= 1 << key;
 }
 
-void Sequencer::playNotesStart() {
+void Sequencer::applyDiff(const SongDiff &diff) {
+  for (const Note &i : diff.removed) {
+    auto range = noteStarts.equal_range(const_cast<Note*>(&i));
+    for (auto j = range.first; j != range.second; ++j) {
+      Note *note = *j;
+      if (note->duration != i.duration || note->pitch != i.pitch
+          || note->inst != i.inst)
+        continue;
+      // Notes being recorded are not from the file.
+      bool isBeingRecorded = false;
+      for (Note *k : recordingNotes)
+        isBeingRecorded |= k == note;
+      if (isBeingRecorded) continue;
+      if (isPlaying && !keyboard.isEventMode()
+          && note->startTime <= tilePos && note->endTime() >= tilePos)
+        keyboard.setSequencer(note->pitch, note->inst, false);
+      removeNote(note);
+      break;
+    }
+  }
+
+  for (const Note &i : diff.added) {
+    Note *note = addNote(i);
+    if (isPlaying && !keyboard.isEventMode()
+        && note->startTime == tilePos && !isNoteInRecordingRange(note))
+      keyboard.setSequencer(note->pitch, note->inst, true);
+  }
+
+  if (diff.loopChanged)
+    setLoop(diff.loopStart, diff.loopEnd);
+  if (diff.tempoChanged)
+    setTempo(diff.tempo);
+  if (isPlaying && keyboard.isEventMode())
+    resyncKeys();
+}
+
+void Sequencer::swapSong(LoadedSong &song) {
+  // The old notes stay in song until it's freed, so that the view and
+  // the notes being recorded can still be cleared by seek.
+  notes.swap(song.notes);
+  noteStarts.swap(song.noteStarts);
+  noteEnds.swap(song.noteEnds);
+  longNotes.swap(song.longNotes);
+  tempo.swap(song.tempo);
+  setLoop(song.loopStart, song.loopEnd);
+  for (Note *&i : recordingNotes)
+    i = nullptr;
+  seek(0);
+}
+
+void Sequencer::playNotesStart(uint32_t step) {
   Note target;
-  target.startTime = tilePos;
+  target.startTime = step;
   auto range = noteStarts.equal_range(&target);
   for (auto i = range.first; i != range.second; ++i) {
     Note *note = *i;
@@ -296,9 +497,9 @@ void Sequencer::playNotesStart() {
   }
 }
 
-void Sequencer::playNotesEnd() {
+void Sequencer::playNotesEnd(uint32_t step) {
   Note target;
-  target.startTime = tilePos;
+  target.startTime = step;
   target.duration = 1;
   auto range = noteEnds.equal_range(&target);
   for (auto i = range.first; i != range.second; ++i) {
@@ -309,8 +510,184 @@ void Sequencer::playNotesEnd() {
 
 bool Sequencer::isNoteInRecordingRange(const Note *note) {
   if (!isRecording) return false;
-  uint8_t octave = note->pitch / 12;
+  uint8_t octave = note->pitch / Layout::KEYS_PER_OCTAVE;
   if (octave != main.getOctave()) return false;
-  if (octave == 4) return true;
+  if (octave == Layout::DRUM_OCTAVE) return true;
   return note->inst == main.getInst();
 }
+
+template <typename F>
+void Sequencer::forEachNote(uint32_t from, uint32_t to, F f) {
+  // Other notes start at most LONG_NOTE_STEPS - 1 steps before from.
+  Note target;
+  target.startTime = from < LONG_NOTE_STEPS ? 0 : from - LONG_NOTE_STEPS;
+  auto i = noteStarts.lower_bound(&target);
+  target.startTime = to;
+  auto end = noteStarts.upper_bound(&target);
+  for (; i != end; ++i)
+    if ((*i)->duration <= LONG_NOTE_STEPS && (*i)->endTime() >= from)
+      f(*i);
+  for (Note *note : longNotes)
+    if (note->startTime <= to && note->endTime() >= from)
+      f(note);
+}
+
+void Sequencer::invalidateLoopKeys(const Note *note) {
+  if (loopEnd && note->startTime <= loopStart && note->endTime() >= loopStart)
+    loopKeysValid = false;
+}
+
+void Sequencer::computeLoopKeys() {
+  for (InstMask &i : loopKeys)
+    i = 0;
+  forEachNote(loopStart, loopStart, [&](Note *note) {
+    loopKeys[note->pitch] |= 1 << note->inst;
+  });
+  loopKeysValid = true;
+}
+
+void Sequencer::setLoop(uint32_t start, uint32_t end) {
+  loopStart = start;
+  loopEnd = end;
+  loopKeysValid = false;
+}
+
+void Sequencer::wrapLoop() {
+  // Notes being recorded are cut at the end of the loop.
+  for (Note *&i : recordingNotes)
+    i = nullptr;
+
+  tilePos = loopStart;
+  timeStep(true);
+  redrawView();
+  writeScrollRegs();
+
+  // In event mode, the keys were scheduled one step ahead.
+  if (!keyboard.isEventMode())
+    playLoopKeys();
+  if (isRecording) writeRecordedNotes(tilePos);
+}
+
+void Sequencer::playLoopKeys() {
+  // Switch all keys to the states at the start of the loop at once, so
+  // that note-offs and note-ons at the wrap land in the same boundary.
+  if (!loopKeysValid)
+    computeLoopKeys();
+  uint8_t octave = main.getOctave();
+  for (uint8_t i = 0; i < Layout::KEYS; ++i) {
+    InstMask keys = loopKeys[i];
+    if (isRecording && i / Layout::KEYS_PER_OCTAVE == octave)
+      keys &= octave == Layout::DRUM_OCTAVE ? 0 : ~(1 << main.getInst());
+    keyboard.setSequencerKeys(i, keys);
+  }
+}
+
+void Sequencer::timeStep(bool anchor) {
+  // Time bases wrap around, and so does the origin.
+  if (anchor)
+    tempoOrigin = (static_cast<uint64_t>(lastBoundary) << TEMPO_FRAC_BITS) - tempo.boundary(tilePos);
+  uint32_t next = (tempoOrigin + tempo.boundary(tilePos + 1)) >> TEMPO_FRAC_BITS;
+  stepLength = next - lastBoundary;
+  scrollScale = tempo.scrollScale(tilePos);
+}
+
+void Sequencer::setTempo(const std::vector<TempoChange> &changes) {
+  tempo.assign(changes);
+  if (isPlaying) {
+    timeStep(true);
+    // Keys of the next step were scheduled at the old time.
+    if (keyboard.isEventMode())
+      resyncKeys();
+  }
+}
+
+void Sequencer::setEventTime(uint32_t time) {
+  keyboard.setEventTime(main.getSampleCount(time));
+}
+
+void Sequencer::scheduleNextStep() {
+  // Events must be pushed in the order of their times, so changes at
+  // the current time are made before this is called. Events too far
+  // ahead would be taken as past ones, see H2F_KEY_EVENT_HORIZON.
+  int32_t ahead = lastBoundary + stepLength - main.getTimeBase();
+  nextScheduled = !nextDropped && ahead <= H2F_KEY_EVENT_HORIZON;
+  if (!nextScheduled)
+    return;
+  setEventTime(lastBoundary + stepLength);
+  if (loopEnd && tilePos + 1 == loopEnd) {
+    playLoopKeys();
+  } else {
+    playNotesEnd(tilePos);
+    playNotesStart(tilePos + 1);
+  }
+  setEventTime(main.getTimeBase());
+
+  // More changes than the FIFO holds, which it drops so that the rest
+  // stay in order. Restore the current keys and push the changes once
+  // the step starts, when they are due right away.
+  if (h2f.keyEventsDropped()) {
+    nextDropped = true;
+    resyncKeys();
+  }
+}
+
+void Sequencer::resyncKeys() {
+  keyboard.clearSequencer();
+  setEventTime(main.getTimeBase());
+  for (Note *note : view)
+    if (note->startTime <= tilePos && note->endTime() >= tilePos
+        && !isNoteInRecordingRange(note))
+      keyboard.setSequencer(note->pitch, note->inst, true);
+  scheduleNextStep();
+}
+
+void Sequencer::seek(uint32_t pos) {
+  if (isPlaying) {
+    keyboard.clearSequencer();
+    for (Note *&i : recordingNotes)
+      i = nullptr;
+  }
+  tilePos = pos;
+  redrawView();
+  writeScrollRegs();
+  if (isPlaying) {
+    timeStep(true);
+    if (keyboard.isEventMode())
+      resyncKeys();
+    else
+      playNotesStart(tilePos);
+  }
+}
+
+void Sequencer::getStatus(StatusData &out) const {
+  out.tilePos = tilePos;
+  out.lastBoundary = lastBoundary;
+  out.loopStart = loopStart;
+  out.loopEnd = loopEnd;
+  out.noteCount = notes.size();
+  out.viewCount = view.size();
+  out.isPlaying = isPlaying;
+  out.isRecording = isPlaying && isRecording;
+}
+
+void Sequencer::redrawView() {
+  for (auto i = view.begin(); i != view.end(); )
+    i = removeFromView(*i);
+
+  // Draw all visible notes into a clean buffer.
+  TileState oldStates[Layout::TILES];
+  std::copy(tileStates, tileStates + Layout::TILES, oldStates);
+  std::fill(tileStates, tileStates + Layout::TILES, 0);
+  uint64_t oldDirtyRows = dirtyRows;
+  uint32_t bottom = tilePos < Layout::ROWS_BELOW ? 0 : tilePos - Layout::ROWS_BELOW;
+  forEachNote(bottom, tilePos + Layout::ROWS_ABOVE, [&](Note *note) {
+    if (drawCompleteNote(note, false))
+      addToView(note);
+  });
+
+  // Only write the tiles that changed.
+  dirtyRows = oldDirtyRows;
+  for (uint16_t i = 0; i < Layout::TILES; ++i)
+    if (tileStates[i] != oldStates[i])
+      markDirty(i);
+}
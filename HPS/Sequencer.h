@@ -1,53 +1,138 @@
 #ifndef _SEQUENCER_H_
 #define _SEQUENCER_H_
+#include <vector>
 #include "H2F.h"
 #include "Note.h"
 #include "Keyboard.h"
-
-#define SAMPLES_PER_16TH 4800
+#include "Layout.h"
+#include "SongAnalysis.h"
+#include "SongFile.h"
+#include "StatusPage.h"
+#include "TempoMap.h"
 
 // Sequencer: manages the list of notes.
 // Author: Yibo Cao
 
+// Notes longer than this many steps are also kept in a list of their
+// own, so that finding the notes at a step only looks this far back.
+#define LONG_NOTE_STEPS Layout::ROWS
+
+struct LoadedSong;
+
 class Sequencer {
+  friend class ViewChecker;
   class Main &main;
   Keyboard &keyboard;
   H2F &h2f;
   bool isPlaying, isRecording;
   uint32_t lastBoundary;
-  uint32_t tileStates[49 * 64];
+  // In event mode, whether the keys of the next step are scheduled.
+  // Those of a step longer than H2F_KEY_EVENT_HORIZON wait until its
+  // end is close enough, and those that didn't fit in the FIFO ahead of
+  // time (nextDropped) until the step starts.
+  bool nextScheduled, nextDropped;
+
+  // Tempo, and the timing of the current step: the time base of step 0
+  // with TEMPO_FRAC_BITS fraction bits, the length of the current step
+  // and its subtile scroll for each sample.
+  TempoMap tempo;
+  uint64_t tempoOrigin;
+  uint32_t stepLength;
+  uint64_t scrollScale;
+  TileState tileStates[Layout::TILES];
+
+  // Tiles changed since the last flush: a bit per physical row, and the
+  // range of pitches changed in each row.
+  uint64_t dirtyRows;
+  uint8_t dirtyLo[Layout::ROWS], dirtyHi[Layout::ROWS];
 
   // Key states for recording.
   uint16_t everPressed, everReleased, lastKeyStates;
 
-  // List of notes and two sorted indices for fast lookup.
+  // List of notes, two sorted indices and the long notes for fast
+  // lookup.
   std::list<Note> notes;
   std::list<Note*> view;
   std::multiset<Note*, LessStartTime> noteStarts;
   std::multiset<Note*, LessEndTime> noteEnds;
-  Note *recordingNotes[12];
+  std::set<Note*> longNotes;
+  Note *recordingNotes[Layout::KEYS_PER_OCTAVE];
 
   // Scrolling position.
   uint32_t tilePos;
   uint8_t tileOffset;
 
+  // Whether the FPGA renders the view from a list of notes instead of
+  // tiles, and the free slots of that list.
+  bool noteDisplay;
+  std::vector<uint8_t> freeSlots;
+
+  // Loop region (disabled if loopEnd is 0) and the precomputed
+  // sequencer key states at the start of the loop.
+  uint32_t loopStart, loopEnd;
+  InstMask loopKeys[Layout::KEYS];
+  bool loopKeysValid;
+
   void writeScrollRegs();
+  void markDirty(uint16_t addr);
   void addToView(Note *note);
+  Note::ItrView removeFromView(Note *note);
+  void uploadNote(Note *note);
   void setTileState(uint8_t row, uint8_t pitch, uint8_t inst, uint8_t state);
-  void playNotesStart();
-  void playNotesEnd();
+  void playNotesStart(uint32_t step);
+  void playNotesEnd(uint32_t step);
   bool isNoteInRecordingRange(const Note *note);
-  void writeRecordedNotes();
+  void writeRecordedNotes(uint32_t step);
   Note::ItrView removeNote(Note *note);
+  // Calls f with each note from step from to step to, in no order.
+  template <typename F>
+  void forEachNote(uint32_t from, uint32_t to, F f);
+  void invalidateLoopKeys(const Note *note);
+  void computeLoopKeys();
+  void playLoopKeys();
+  void wrapLoop();
+  void scrollStep(bool positive);
+  // Times the current step, after moving to the next step or, with
+  // anchor set, from lastBoundary after a jump.
+  void timeStep(bool anchor);
+  // Event mode: sequencer changes are sent as timestamped events.
+  void setEventTime(uint32_t time);
+  // Schedules the key changes at the next boundary.
+  void scheduleNextStep();
+  // Drops scheduled events and restarts from the current position,
+  // after changes that invalidate them.
+  void resyncKeys();
+  // Rebuild the view at the current position and write changed tiles.
+  void redrawView();
   // Draw a complete note on the screen.
   // Returns whether the note is visible at all.
   bool drawCompleteNote(Note *note, bool remove);
 public:
   Sequencer(H2F &h2f, Keyboard &keyboard, Main &main);
-  void update(bool play, bool record, uint16_t keyStates);
+  // Returns whether it's safe to edit notes, i.e. the playback is
+  // stopped or has just crossed a boundary.
+  bool update(bool play, bool record, uint16_t keyStates);
+  // Registers a press or release of a key between updates, so that keys
+  // pressed and released within one update are still recorded.
+  void onRecordKey(uint8_t key, bool on);
   void scroll(bool positive);
+  void seek(uint32_t pos);
+  void setLoop(uint32_t start, uint32_t end);
+  void setTempo(const std::vector<TempoChange> &changes);
+  void setNoteDisplay(bool on);
   Note *addNote(const Note &params);
+  void applyDiff(const SongDiff &diff);
+  // Swaps all notes, the loop region and the tempo with a song loaded
+  // ahead of time, and starts it from step 0. Only the view is redrawn.
+  void swapSong(LoadedSong &song);
   bool shouldLockView() const;
+  // Length of the current step in samples, as of the last update.
+  uint32_t getStepLength() const { return stepLength; }
+  // Writes changed tiles to the FPGA in bursts.
+  void flushTiles();
+  void getStatus(StatusData &out) const;
+  // Defined in SongAnalysis.cpp.
+  void analyze(SongAnalysis &out) const;
 };
 
 #endif
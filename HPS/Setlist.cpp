@@ -0,0 +1,140 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include "Sequencer.h"
+#include "Setlist.h"
+
+void LoadedSong::assign(const SongFile &song) {
+  for (const Note &i : song.notes) {
+    notes.push_front(i);
+    Note *note = &notes.front();
+    note->itrList = notes.begin();
+    note->itrSetS = noteStarts.insert(note);
+    note->itrSetE = noteEnds.insert(note);
+    if (note->duration > LONG_NOTE_STEPS)
+      longNotes.insert(note);
+    note->isInView = false;
+    note->slot = -1;
+  }
+  loopStart = song.loopStart;
+  loopEnd = song.loopEnd;
+  tempo.assign(song.tempo);
+}
+
+void LoadedSong::load(const std::string &path) {
+  SongFile song;
+  song.load(path);
+  this->path = path;
+  assign(song);
+  analyzeNotes(noteStarts, noteEnds, analysis);
+  watcher.reset(new SongWatcher(path, song));
+}
+
+Setlist::Setlist(const std::string &path)
+    :wakeRead(-1), wakeWrite(-1), standby(nullptr), retired(nullptr),
+    stopping(false), nextIndex(0) {
+  std::ifstream file(path);
+  if (!file)
+    throw std::runtime_error("failed to open " + path);
+  size_t slash = path.rfind('/');
+  std::string dir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream in(line);
+    std::string song;
+    if (!(in >> song) || song[0] == '#')
+      continue;
+    paths.push_back(song[0] == '/' ? song : dir + song);
+  }
+  if (paths.empty())
+    throw std::runtime_error(path + ": no songs");
+
+  std::unique_ptr<LoadedSong> first(new LoadedSong);
+  first->load(paths[0]);
+  report(*first);
+  standby = first.release();
+  nextIndex = 1 % paths.size();
+
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) < 0)
+    throw std::runtime_error("failed to create pipe");
+  wakeRead.fd = fds[0];
+  wakeWrite.fd = fds[1];
+  thread = std::thread(&Setlist::threadMain, this);
+}
+
+Setlist::~Setlist() {
+  stopping = true;
+  char dummy = 0;
+  if (write(wakeWrite.fd, &dummy, 1) == 1)
+    thread.join();
+  else
+    thread.detach();
+  delete standby.load();
+  delete retired.load();
+}
+
+void Setlist::wake() {
+  char dummy = 0;
+  if (write(wakeWrite.fd, &dummy, 1) != 1)
+    std::cout << "setlist: failed to wake the loader" << std::endl;
+}
+
+void Setlist::report(const LoadedSong &song) const {
+  std::cout << "setlist: loaded song " << song.index + 1 << "/" << paths.size()
+    << ": " << song.path << std::endl;
+  song.analysis.report(std::cout);
+}
+
+void Setlist::threadMain() {
+  // Failed loads in a row, to stop retrying when no song loads.
+  uint32_t failures = 0;
+  for (;;) {
+    // The path and the index stay with the song that was swapped in.
+    if (LoadedSong *song = retired.exchange(nullptr)) {
+      std::cout << "song " << song->index + 1 << "/" << paths.size() << ": " << song->path
+        << " (" << song->switchUs << " us)" << std::endl;
+      delete song;
+    }
+
+    if (!standby.load() && failures < paths.size()) {
+      uint32_t index = nextIndex;
+      nextIndex = (index + 1) % paths.size();
+      std::unique_ptr<LoadedSong> song(new LoadedSong);
+      try {
+        song->load(paths[index]);
+      } catch (std::exception &x) {
+        std::cout << "setlist: skipped song " << index + 1 << ": " << x.what() << std::endl;
+        ++failures;
+        continue;
+      }
+      song->index = index;
+      report(*song);
+      failures = 0;
+      standby = song.release();
+      continue;
+    }
+
+    pollfd fds = {wakeRead.fd, POLLIN, 0};
+    if (::poll(&fds, 1, -1) < 0)
+      continue;
+    char buffer[64];
+    if (read(wakeRead.fd, buffer, sizeof(buffer)) <= 0 || stopping)
+      return;
+    failures = 0;
+  }
+}
+
+std::unique_ptr<LoadedSong> Setlist::take() {
+  if (retired.load(std::memory_order_relaxed) || !standby.load(std::memory_order_relaxed))
+    return nullptr;
+  return std::unique_ptr<LoadedSong>(standby.exchange(nullptr));
+}
+
+void Setlist::retire(std::unique_ptr<LoadedSong> song) {
+  retired = song.release();
+  wake();
+}
@@ -0,0 +1,73 @@
+#ifndef _SETLIST_H_
+#define _SETLIST_H_
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FDGuard.h"
+#include "Note.h"
+#include "SongAnalysis.h"
+#include "SongFile.h"
+#include "SongWatcher.h"
+#include "TempoMap.h"
+
+// Setlist: plays a list of song files one after another. The next song
+//   is loaded and indexed on a background thread into a standby song,
+//   which Sequencer::swapSong swaps with the active one in constant
+//   time. The swapped out song is handed back and freed on the same
+//   thread, so that the real-time loop never parses, allocates or frees
+//   a whole song. The loader thread also prints the analysis of each
+//   song it loads and the switch to each song once it's retired.
+//   A setlist file lists song files, one per line, relative to itself.
+//   Empty lines and lines starting with '#' are skipped.
+
+// A song indexed the way Sequencer keeps it, see Sequencer::addNote.
+struct LoadedSong {
+  std::string path;
+  uint32_t index;
+  std::list<Note> notes;
+  std::multiset<Note*, LessStartTime> noteStarts;
+  std::multiset<Note*, LessEndTime> noteEnds;
+  std::set<Note*> longNotes;
+  uint32_t loopStart, loopEnd;
+  TempoMap tempo;
+  SongAnalysis analysis;
+  // How long the real-time loop took to swap the song in.
+  double switchUs;
+  // Watches the file for edits once the song is active.
+  std::unique_ptr<SongWatcher> watcher;
+  LoadedSong() :index(0), loopStart(0), loopEnd(0), switchUs(0) {}
+  void assign(const SongFile &song);
+  void load(const std::string &path);
+};
+
+class Setlist {
+  std::vector<std::string> paths;
+  FDGuard wakeRead, wakeWrite;
+
+  // Mailboxes to and from the real-time loop. Each is only filled by
+  // one side and emptied by the other.
+  std::atomic<LoadedSong*> standby, retired;
+  std::atomic<bool> stopping;
+  uint32_t nextIndex;
+
+  std::thread thread;
+  void threadMain();
+  void wake();
+  void report(const LoadedSong &song) const;
+public:
+  // Loads the first song before returning, so that it can be taken
+  // right away.
+  explicit Setlist(const std::string &path);
+  ~Setlist();
+  uint32_t size() const { return paths.size(); }
+  // Takes the next song if it's ready and the previous one has been
+  // freed. Never blocks.
+  std::unique_ptr<LoadedSong> take();
+  // Hands a swapped out song back to be freed, and starts loading the
+  // song after the taken one.
+  void retire(std::unique_ptr<LoadedSong> song);
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include "Sequencer.h"
+#include "SongAnalysis.h"
+
+namespace {
+  // Voices of the synthesizer of each instrument in synthesizers.sv:
+  // saw_lead_poly, super_saw_poly, saw_bass_mono and square_delay_poly.
+  const uint8_t VOICES[] = {4, 4, 1, 4};
+  // On the drum key, kick_drum plays instruments 0 to 3 as modes of a
+  // single voice, snare_drum plays 4 and hi_hat plays 5.
+  const uint8_t KICK_MODES = 4, DRUMS = 6;
+  const uint8_t HOTSPOTS = 5;
+
+  uint8_t voicesOf(uint8_t inst) {
+    return inst < sizeof(VOICES) ? VOICES[inst] : 0;
+  }
+}
+
+void Sequencer::analyze(SongAnalysis &out) const {
+  analyzeNotes(noteStarts, noteEnds, out);
+}
+
+void analyzeNotes(const std::multiset<Note*, LessStartTime> &noteStarts,
+    const std::multiset<Note*, LessEndTime> &noteEnds, SongAnalysis &out) {
+  out = SongAnalysis();
+  uint32_t steps = noteEnds.empty() ? 0 : (*noteEnds.rbegin())->endTime() + 1;
+  out.steps = steps;
+
+  // The notes only change at the starts and right after the ends, so
+  // the sweep visits those steps alone: the key changes at the boundary
+  // into each of them, and the pitch range of the notes from there up to
+  // the next one.
+  struct Event {
+    uint32_t step, changes;
+    uint8_t lo, hi;
+  };
+  std::vector<Event> events;
+  uint16_t pitchNotes[Layout::KEYS] = {}, instNotes[Layout::INSTS] = {};
+  int32_t openOverflow[Layout::INSTS];
+  std::fill(openOverflow, openOverflow + Layout::INSTS, -1);
+
+  auto start = noteStarts.begin();
+  auto end = noteEnds.begin();
+  auto nextStep = [&]() {
+    uint32_t step = steps;
+    if (start != noteStarts.end())
+      step = std::min(step, (*start)->startTime);
+    if (end != noteEnds.end())
+      step = std::min(step, (*end)->endTime() + 1);
+    return step;
+  };
+  while (start != noteStarts.end() || end != noteEnds.end()) {
+    uint32_t step = nextStep();
+    Event event = {step, 0, Layout::KEYS, 0};
+    for (; end != noteEnds.end() && (*end)->endTime() + 1 == step; ++end) {
+      const Note *note = *end;
+      ++event.changes;
+      --pitchNotes[note->pitch];
+      if (note->pitch != Layout::DRUM_KEY)
+        --instNotes[note->inst];
+    }
+    uint8_t kicks = 0;
+    for (; start != noteStarts.end() && (*start)->startTime == step; ++start) {
+      const Note *note = *start;
+      ++event.changes;
+      ++pitchNotes[note->pitch];
+      if (note->pitch == Layout::DRUM_KEY) {
+        kicks += note->inst < KICK_MODES;
+        out.unvoicedDrums[note->inst] += note->inst >= DRUMS;
+      } else {
+        ++instNotes[note->inst];
+        out.unvoiced[note->inst] += !voicesOf(note->inst);
+      }
+    }
+    if (kicks > 1)
+      out.kickConflicts.push_back(step);
+
+    // The notes stay the same up to the last step before the next event.
+    uint32_t last = nextStep() - 1;
+    for (uint8_t i = 0; i < Layout::INSTS; ++i) {
+      if (instNotes[i] > out.peak[i]) {
+        out.peak[i] = std::min<uint16_t>(instNotes[i], UINT8_MAX);
+        out.peakAt[i] = step;
+      }
+      uint8_t voices = voicesOf(i);
+      if (voices && instNotes[i] > voices) {
+        uint8_t notes = std::min<uint16_t>(instNotes[i], UINT8_MAX);
+        if (openOverflow[i] < 0) {
+          openOverflow[i] = out.overflows.size();
+          out.overflows.push_back(SongAnalysis::Overflow{i, notes, step, last});
+        } else {
+          SongAnalysis::Overflow &run = out.overflows[openOverflow[i]];
+          run.end = last;
+          run.notes = std::max(run.notes, notes);
+        }
+      } else {
+        openOverflow[i] = -1;
+      }
+    }
+
+    for (uint8_t i = 0; i < Layout::KEYS; ++i) {
+      if (!pitchNotes[i]) continue;
+      event.lo = std::min(event.lo, i);
+      event.hi = i;
+    }
+    events.push_back(event);
+  }
+
+  // Crossing into a step rewrites the row recycled from the bottom of
+  // the view to the top in one burst, see Sequencer::scrollStep and
+  // flushTiles: clearing the notes at the old bottom row and drawing
+  // the notes at the new top row. The scroll registers take 2 writes.
+  // The count only changes where either row or the key changes do, so
+  // it is taken once for each run of steps between those.
+  auto eventAt = [&](uint64_t step) {
+    return std::upper_bound(events.begin(), events.end(), step,
+      [](uint64_t x, const Event &y) { return x < y.step; });
+  };
+  std::vector<uint64_t> cuts = {1, Layout::ROWS_BELOW + 1};
+  for (const Event &i : events) {
+    cuts.push_back(i.step);
+    cuts.push_back(i.step + 1);
+    cuts.push_back(i.step + 1 + static_cast<uint64_t>(Layout::ROWS_BELOW));
+    if (i.step >= Layout::ROWS_ABOVE)
+      cuts.push_back(i.step - Layout::ROWS_ABOVE);
+  }
+  cuts.erase(std::remove_if(cuts.begin(), cuts.end(),
+    [&](uint64_t x) { return x < 1 || x > steps; }), cuts.end());
+  std::sort(cuts.begin(), cuts.end());
+  cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+  cuts.push_back(static_cast<uint64_t>(steps) + 1);
+
+  std::vector<std::pair<uint32_t, uint32_t>> writes;
+  for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+    uint64_t step = cuts[i];
+    uint8_t rowLo = Layout::KEYS, rowHi = 0;
+    auto addRow = [&](uint64_t row) {
+      auto event = eventAt(row);
+      if (row >= steps || event == events.begin()) return;
+      --event;
+      if (event->lo > event->hi) return;
+      rowLo = std::min(rowLo, event->lo);
+      rowHi = std::max(rowHi, event->hi);
+    };
+    if (step - 1 >= Layout::ROWS_BELOW)
+      addRow(step - 1 - Layout::ROWS_BELOW);
+    addRow(step + Layout::ROWS_ABOVE);
+    auto event = eventAt(step);
+    uint32_t changes = event != events.begin() && (event - 1)->step == step ? (event - 1)->changes : 0;
+    uint32_t count = 2 + changes + (rowLo <= rowHi ? rowHi - rowLo + 1 : 0);
+    uint64_t length = cuts[i + 1] - step;
+    out.writeRuns.push_back(SongAnalysis::WriteRun{static_cast<uint32_t>(step), count});
+    out.totalWrites += count * length;
+    out.maxWrites = std::max(out.maxWrites, count);
+    // Ties go to the earliest steps, so only the first few of a run can
+    // be hotspots.
+    for (uint64_t j = 0; j < std::min<uint64_t>(length, HOTSPOTS); ++j)
+      writes.push_back(std::make_pair(count, static_cast<uint32_t>(step + j)));
+  }
+  uint32_t hotspots = std::min<uint32_t>(HOTSPOTS, writes.size());
+  std::partial_sort(writes.begin(), writes.begin() + hotspots, writes.end(),
+    [](const std::pair<uint32_t, uint32_t> &x, const std::pair<uint32_t, uint32_t> &y) {
+      return x.first > y.first || (x.first == y.first && x.second < y.second);
+    });
+  for (uint32_t i = 0; i < hotspots; ++i)
+    out.hotspots.push_back(std::make_pair(writes[i].second, writes[i].first));
+}
+
+uint32_t SongAnalysis::writesAt(uint32_t step) const {
+  auto i = std::upper_bound(writeRuns.begin(), writeRuns.end(), step,
+    [](uint32_t x, const WriteRun &y) { return x < y.start; });
+  // Past the notes, only the scroll registers are written.
+  if (step > steps || i == writeRuns.begin())
+    return 2;
+  return (i - 1)->writes;
+}
+
+bool SongAnalysis::hasWarnings() const {
+  if (!overflows.empty() || !kickConflicts.empty())
+    return true;
+  for (uint8_t i = 0; i < Layout::INSTS; ++i)
+    if (unvoiced[i] || unvoicedDrums[i])
+      return true;
+  return false;
+}
+
+void SongAnalysis::report(std::ostream &out) const {
+  out << "song: " << steps << " steps, peak notes/voices";
+  bool tonal = false;
+  for (uint8_t i = 0; i < Layout::INSTS; ++i) {
+    if (!peak[i]) continue;
+    out << " " << +i << ":" << +peak[i] << "/" << +voicesOf(i);
+    tonal = true;
+  }
+  out << (tonal ? "" : " none on tonal keys") << std::endl;
+  if (steps) {
+    out << "boundary writes: mean " << static_cast<double>(totalWrites) / steps
+      << ", max " << maxWrites << ", at steps";
+    for (const auto &i : hotspots)
+      out << " " << i.first << " (" << i.second << ")";
+    out << std::endl;
+  }
+
+  for (const Overflow &i : overflows)
+    out << "warning: instrument " << +i.inst << " has " << +i.notes << " notes for "
+      << +voicesOf(i.inst) << " voices at steps " << i.start << "-" << i.end << std::endl;
+  for (uint8_t i = 0; i < Layout::INSTS; ++i) {
+    if (unvoiced[i])
+      out << "warning: " << unvoiced[i] << " notes of instrument " << +i
+        << ", which has no synthesizer" << std::endl;
+    if (unvoicedDrums[i])
+      out << "warning: " << unvoicedDrums[i] << " notes of drum " << +i
+        << ", which has no synthesizer" << std::endl;
+  }
+  if (!kickConflicts.empty()) {
+    out << "warning: several kick drums start at " << kickConflicts.size()
+      << " steps, from step " << kickConflicts.front() << ", only one plays" << std::endl;
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef _SONG_ANALYSIS_H_
+#define _SONG_ANALYSIS_H_
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "Layout.h"
+#include "Note.h"
+
+// SongAnalysis: what a song asks of the FPGA, found in one sweep over
+//   the sorted note starts and ends of Sequencer (Sequencer::analyze)
+//   or of a song loaded ahead of time.
+//   - Peak concurrent notes of each instrument, against the voices of
+//     its synthesizer in synthesizers.sv.
+//   - Steps where an instrument needs more voices than it has, and notes
+//     of instruments without a synthesizer.
+//   - Predicted bridge writes at each boundary of playback in tile mode:
+//     the scroll registers, the key changes and the burst rewriting the
+//     recycled tile row.
+
+struct SongAnalysis {
+  uint32_t steps;
+  uint8_t peak[Layout::INSTS];
+  uint32_t peakAt[Layout::INSTS];
+
+  // Runs of steps where an instrument has more notes than voices.
+  struct Overflow {
+    uint8_t inst, notes;
+    uint32_t start, end;
+  };
+  std::vector<Overflow> overflows;
+  // Notes no synthesizer plays, of each instrument on the tonal keys
+  // and on the drum key.
+  uint32_t unvoiced[Layout::INSTS], unvoicedDrums[Layout::INSTS];
+  // Steps where several kick drum modes start, of which only one plays.
+  std::vector<uint32_t> kickConflicts;
+
+  // Bridge writes at the boundary into each step, in runs of steps
+  // with the same count, and the most expensive boundaries.
+  struct WriteRun {
+    uint32_t start, writes;
+  };
+  std::vector<WriteRun> writeRuns;
+  uint64_t totalWrites;
+  uint32_t maxWrites;
+  std::vector<std::pair<uint32_t, uint32_t>> hotspots;
+
+  // Predicted bridge writes at the boundary into a step.
+  uint32_t writesAt(uint32_t step) const;
+  bool hasWarnings() const;
+  void report(std::ostream &out) const;
+};
+
+void analyzeNotes(const std::multiset<Note*, LessStartTime> &noteStarts,
+  const std::multiset<Note*, LessEndTime> &noteEnds, SongAnalysis &out);
+
+#endif
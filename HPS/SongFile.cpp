@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include "Layout.h"
+#include "SongFile.h"
+
+bool LessNoteContent::operator()(const Note &x, const Note &y) const {
+  if (x.startTime != y.startTime) return x.startTime < y.startTime;
+  if (x.duration != y.duration) return x.duration < y.duration;
+  if (x.pitch != y.pitch) return x.pitch < y.pitch;
+  return x.inst < y.inst;
+}
+
+void SongFile::load(const std::string &path) {
+  std::ifstream file(path);
+  if (!file)
+    throw std::runtime_error("failed to open " + path);
+  notes.clear();
+  tempo.clear();
+  loopStart = loopEnd = 0;
+  std::string line;
+  for (uint32_t lineNo = 1; std::getline(file, line); ++lineNo) {
+    std::istringstream in(line);
+    std::string word;
+    if (!(in >> word) || word[0] == '#')
+      continue;
+    auto fail = [&](const char *what) {
+      throw std::runtime_error(path + ":" + std::to_string(lineNo) + ": " + what);
+    };
+    if (word == "note") {
+      uint32_t startTime, duration, pitch, inst;
+      if (!(in >> startTime >> duration >> pitch >> inst))
+        fail("expected note <startTime> <duration> <pitch> <inst>");
+      if (!duration) fail("zero duration");
+      if (pitch >= Layout::KEYS) fail("pitch out of range");
+      if (inst >= Layout::INSTS) fail("instrument out of range");
+      Note note;
+      note.startTime = startTime;
+      note.duration = duration;
+      note.pitch = pitch;
+      note.inst = inst;
+      notes.push_back(note);
+    } else if (word == "loop") {
+      if (!(in >> loopStart >> loopEnd))
+        fail("expected loop <start> <end>");
+      if (loopEnd <= loopStart) fail("empty loop");
+    } else if (word == "tempo") {
+      uint32_t step;
+      double samples;
+      if (!(in >> step >> samples))
+        fail("expected tempo <step> <samples per step>");
+      // At least a sample for each subtile of the scroll.
+      if (!(samples >= 16 && samples <= 1 << 20)) fail("tempo out of range");
+      tempo.push_back(TempoChange{step,
+        static_cast<uint32_t>(std::lround(samples * (1 << TEMPO_FRAC_BITS)))});
+    } else {
+      fail("unknown directive");
+    }
+  }
+  std::sort(notes.begin(), notes.end(), LessNoteContent());
+  std::sort(tempo.begin(), tempo.end(),
+    [](const TempoChange &x, const TempoChange &y) { return x.step < y.step; });
+  for (size_t i = 1; i < tempo.size(); ++i)
+    if (tempo[i].step == tempo[i - 1].step)
+      throw std::runtime_error(path + ": two tempos at step " + std::to_string(tempo[i].step));
+}
+
+SongDiff diffSongs(const SongFile &from, const SongFile &to) {
+  SongDiff result;
+  std::set_difference(to.notes.begin(), to.notes.end(),
+    from.notes.begin(), from.notes.end(),
+    std::back_inserter(result.added), LessNoteContent());
+  std::set_difference(from.notes.begin(), from.notes.end(),
+    to.notes.begin(), to.notes.end(),
+    std::back_inserter(result.removed), LessNoteContent());
+  result.loopChanged = from.loopStart != to.loopStart || from.loopEnd != to.loopEnd;
+  result.loopStart = to.loopStart;
+  result.loopEnd = to.loopEnd;
+  result.tempoChanged = from.tempo != to.tempo;
+  result.tempo = to.tempo;
+  return result;
+}
@@ -0,0 +1,41 @@
+#ifndef _SONG_FILE_H_
+#define _SONG_FILE_H_
+#include <string>
+#include <vector>
+#include "Note.h"
+#include "TempoMap.h"
+
+// SongFile: loads songs from text files so they can be edited
+//   without recompiling. Each non-empty line is either a comment
+//   starting with '#' or one of the following directives:
+//     note <startTime> <duration> <pitch> <inst>
+//     loop <start> <end>    (end is exclusive)
+//     tempo <step> <samples per step, may be fractional>
+
+// Orders notes by content, used for diffing two versions of a song.
+struct LessNoteContent { bool operator()(const Note &x, const Note &y) const; };
+
+// Changes between two versions of a song.
+struct SongDiff {
+  std::vector<Note> added, removed;
+  bool loopChanged, tempoChanged;
+  uint32_t loopStart, loopEnd;
+  std::vector<TempoChange> tempo;
+  SongDiff() :loopChanged(false), tempoChanged(false), loopStart(0), loopEnd(0) {}
+  bool empty() const { return added.empty() && removed.empty() && !loopChanged && !tempoChanged; }
+};
+
+struct SongFile {
+  // Sorted by LessNoteContent.
+  std::vector<Note> notes;
+  // Loop region, disabled if loopEnd is 0.
+  uint32_t loopStart, loopEnd;
+  // Sorted by step.
+  std::vector<TempoChange> tempo;
+  SongFile() :loopStart(0), loopEnd(0) {}
+  void load(const std::string &path);
+};
+
+SongDiff diffSongs(const SongFile &from, const SongFile &to);
+
+#endif
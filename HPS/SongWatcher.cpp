@@ -0,0 +1,121 @@
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include "SongWatcher.h"
+
+SongWatcher::SongWatcher(const std::string &path, const SongFile &initial)
+    :notify(inotify_init1(IN_CLOEXEC)), wakeRead(-1), wakeWrite(-1),
+    base(initial), latest(initial), hasPending(false), stopping(false) {
+  size_t slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    dir = ".";
+    name = path;
+  } else {
+    dir = path.substr(0, slash + 1);
+    name = path.substr(slash + 1);
+  }
+  if (notify.fd < 0)
+    throw std::runtime_error("failed to init inotify");
+
+  // Watch the directory, since editors usually save by renaming a new file.
+  if (inotify_add_watch(notify.fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    throw std::runtime_error("failed to watch " + dir);
+
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) < 0)
+    throw std::runtime_error("failed to create pipe");
+  wakeRead.fd = fds[0];
+  wakeWrite.fd = fds[1];
+  thread = std::thread(&SongWatcher::threadMain, this);
+}
+
+SongWatcher::~SongWatcher() {
+  stopping = true;
+  char dummy = 0;
+  if (write(wakeWrite.fd, &dummy, 1) == 1)
+    thread.join();
+  else
+    thread.detach();
+}
+
+void SongWatcher::threadMain() {
+  alignas(inotify_event) char buffer[4096];
+  for (;;) {
+    pollfd fds[2] = {{notify.fd, POLLIN, 0}, {wakeRead.fd, POLLIN, 0}};
+    if (::poll(fds, 2, -1) < 0)
+      continue;
+    if (fds[1].revents) {
+      char buffer[64];
+      if (read(wakeRead.fd, buffer, sizeof(buffer)) <= 0 || stopping)
+        return;
+      std::unique_ptr<SongDiff> diff;
+      {
+        std::lock_guard<std::mutex> guard(mailLock);
+        diff.swap(applied);
+      }
+      continue;
+    }
+
+    ssize_t size = read(notify.fd, buffer, sizeof(buffer));
+    bool changed = false;
+    for (ssize_t i = 0; i < size; ) {
+      auto event = reinterpret_cast<const inotify_event*>(buffer + i);
+      if (event->len && name == event->name)
+        changed = true;
+      i += sizeof(inotify_event) + event->len;
+    }
+    if (changed)
+      reload();
+  }
+}
+
+void SongWatcher::reload() {
+  SongFile song;
+  try {
+    song.load(dir + name);
+  } catch (std::exception &x) {
+    std::cout << "reload failed: " << x.what() << std::endl;
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(mailLock);
+  // If the previous diff hasn't been taken, replace it with one
+  // that is based on the same contents.
+  if (!pending) std::swap(base, latest);
+  std::unique_ptr<SongDiff> diff(new SongDiff(diffSongs(base, song)));
+  std::swap(latest, song);
+  if (diff->empty()) {
+    pending.reset();
+    base = latest;
+  } else {
+    pending.swap(diff);
+  }
+  hasPending = static_cast<bool>(pending);
+}
+
+bool SongWatcher::poll(std::unique_ptr<SongDiff> &out) {
+  if (!hasPending.load(std::memory_order_relaxed))
+    return false;
+  std::unique_lock<std::mutex> guard(mailLock, std::try_to_lock);
+  if (!guard.owns_lock() || !pending)
+    return false;
+  out.swap(pending);
+  hasPending = false;
+  return true;
+}
+
+bool SongWatcher::complete(std::unique_ptr<SongDiff> &diff) {
+  {
+    std::unique_lock<std::mutex> guard(mailLock, std::try_to_lock);
+    if (!guard.owns_lock() || applied)
+      return false;
+    applied.swap(diff);
+  }
+  char dummy = 0;
+  if (write(wakeWrite.fd, &dummy, 1) != 1)
+    std::cout << "reload: failed to wake the watcher" << std::endl;
+  return true;
+}
@@ -0,0 +1,42 @@
+#ifndef _SONG_WATCHER_H_
+#define _SONG_WATCHER_H_
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "FDGuard.h"
+#include "SongFile.h"
+
+// SongWatcher: watches a song file with inotify. Changes are parsed and
+//   diffed on a background thread, so that the real-time loop only has
+//   to apply the added and removed notes. Applied diffs are handed back
+//   and freed there too.
+
+class SongWatcher {
+  std::string dir, name;
+  FDGuard notify, wakeRead, wakeWrite;
+
+  // Last loaded contents and the contents that the pending diff is based on.
+  // Only accessed by the background thread.
+  SongFile base, latest;
+
+  // Mailboxes to and from the real-time loop.
+  std::mutex mailLock;
+  std::atomic<bool> hasPending, stopping;
+  std::unique_ptr<SongDiff> pending, applied;
+
+  std::thread thread;
+  void threadMain();
+  void reload();
+public:
+  SongWatcher(const std::string &path, const SongFile &initial);
+  ~SongWatcher();
+  // Takes the pending diff if there is one. Never blocks.
+  bool poll(std::unique_ptr<SongDiff> &out);
+  // Hands back an applied diff to be freed. Never blocks, returns false
+  // to be retried.
+  bool complete(std::unique_ptr<SongDiff> &diff);
+};
+
+#endif
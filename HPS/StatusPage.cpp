@@ -0,0 +1,70 @@
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "StatusPage.h"
+
+StatusPublisher::StatusPublisher(const std::string &name)
+    :name(name), fd(shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) {
+  if (fd.fd < 0)
+    throw std::runtime_error("failed to open shared memory " + name);
+  if (ftruncate(fd.fd, sizeof(StatusPage)) < 0)
+    throw std::runtime_error("failed to resize shared memory " + name);
+  void *mem = mmap(nullptr, sizeof(StatusPage), PROT_READ | PROT_WRITE,
+    MAP_SHARED, fd.fd, 0);
+  if (mem == MAP_FAILED)
+    throw std::runtime_error("failed to mmap shared memory " + name);
+  // Fault the page in now, so that updates never page fault.
+  page = new(mem) StatusPage();
+  page->magic = STATUS_PAGE_MAGIC;
+  page->version = STATUS_PAGE_VERSION;
+  page->dataSize = sizeof(StatusData);
+  page->seq.store(0, std::memory_order_release);
+}
+
+StatusPublisher::~StatusPublisher() {
+  munmap(page, sizeof(StatusPage));
+  shm_unlink(name.c_str());
+}
+
+StatusData &StatusPublisher::begin() {
+  page->seq.store(page->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return page->data;
+}
+
+void StatusPublisher::end() {
+  page->seq.store(page->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+StatusReader::StatusReader(const std::string &name)
+    :fd(shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0)) {
+  if (fd.fd < 0)
+    throw std::runtime_error("failed to open shared memory " + name);
+  void *mem = mmap(nullptr, sizeof(StatusPage), PROT_READ, MAP_SHARED, fd.fd, 0);
+  if (mem == MAP_FAILED)
+    throw std::runtime_error("failed to mmap shared memory " + name);
+  page = static_cast<const StatusPage*>(mem);
+  if (page->magic != STATUS_PAGE_MAGIC || page->version != STATUS_PAGE_VERSION
+      || page->dataSize != sizeof(StatusData)) {
+    munmap(mem, sizeof(StatusPage));
+    throw std::runtime_error("incompatible status page " + name);
+  }
+}
+
+StatusReader::~StatusReader() {
+  munmap(const_cast<StatusPage*>(page), sizeof(StatusPage));
+}
+
+bool StatusReader::read(StatusData &out, int attempts) const {
+  while (attempts--) {
+    uint32_t before = page->seq.load(std::memory_order_acquire);
+    if (before & 1) continue;
+    memcpy(&out, &page->data, sizeof(StatusData));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (page->seq.load(std::memory_order_relaxed) == before)
+      return true;
+  }
+  return false;
+}
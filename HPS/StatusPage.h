@@ -0,0 +1,66 @@
+#ifndef _STATUS_PAGE_H_
+#define _STATUS_PAGE_H_
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "FDGuard.h"
+#include "Layout.h"
+
+// StatusPage: a POSIX shared memory page with the state of the
+//   sequencer, for monitors running in other processes. The page is
+//   updated with a seqlock: the writer never waits for readers, and
+//   readers retry when they raced with an update.
+//   Readers only need this header and StatusPage.cpp.
+
+#define STATUS_PAGE_MAGIC   0x53544D46
+#define STATUS_PAGE_VERSION 2
+
+struct StatusData {
+  // Sequencer.
+  uint32_t timeBase, tilePos, lastBoundary;
+  uint32_t loopStart, loopEnd;
+  uint32_t noteCount, viewCount;
+  uint8_t isPlaying, isRecording, activeOctave, activeInst;
+  // Instrument masks of each key, as held by Keyboard.
+  InstMask monitorKeys[Layout::KEYS], sequencerKeys[Layout::KEYS];
+  // Performance counters: loop iterations and boundaries since start,
+  // the longest iteration since the previous update and how late the
+  // last boundary was handled, in samples.
+  uint64_t iterations, boundaries;
+  uint32_t maxIterationSamples, boundaryLateness;
+};
+
+struct StatusPage {
+  // The size of the data depends on the layout the writer was built with.
+  uint32_t magic, version, dataSize;
+  // Odd while an update is in progress.
+  std::atomic<uint32_t> seq;
+  StatusData data;
+};
+
+// Writer, created by the real-time process.
+class StatusPublisher {
+  std::string name;
+  FDGuard fd;
+  StatusPage *page;
+public:
+  explicit StatusPublisher(const std::string &name);
+  ~StatusPublisher();
+  // Returns the data to fill in place between begin and end.
+  StatusData &begin();
+  void end();
+};
+
+// Reader, for monitor processes.
+class StatusReader {
+  FDGuard fd;
+  const StatusPage *page;
+public:
+  explicit StatusReader(const std::string &name);
+  ~StatusReader();
+  // Takes a consistent snapshot. Returns false if the writer kept
+  // updating during all attempts.
+  bool read(StatusData &out, int attempts = 100) const;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include "Tables.h"
+
+namespace {
+  // The hand-written freq_table.sv that the generated table replaced.
+  // The generator must reproduce it exactly.
+  constexpr uint32_t LEGACY_FREQS[] = {
+    33488, 35479, 37589, 39824, 42192, 44701, 47359, 50175, 53159, 56320,
+    59669, 63217, 66976, 70959, 75178, 79649, 84385, 89402, 94719, 100351,
+    106318, 112640, 119338, 126434, 133952, 141918, 150356, 159297, 168769, 178805,
+    189437, 200702, 212636, 225280, 238676, 252868, 267905, 283835, 300713, 318594,
+    337539, 357610, 378874, 401403, 425272, 450560, 477352, 505737
+  };
+  constexpr uint8_t LEGACY_COUNT = sizeof(LEGACY_FREQS) / sizeof(LEGACY_FREQS[0]);
+  constexpr bool matchesLegacy(uint8_t i) {
+    return i == LEGACY_COUNT || (Tables::freq(i) == LEGACY_FREQS[i] && matchesLegacy(i + 1));
+  }
+  static_assert(matchesLegacy(0), "generated frequencies differ from freq_table.sv");
+
+  void writeHex64(std::ostream &out, const char *name, uint64_t value) {
+    out << "\tlocalparam [63:0] " << name << " = 64'h" << std::hex << std::setw(16)
+      << std::setfill('0') << value << std::dec << std::setfill(' ') << ";\n";
+  }
+
+  void open(std::ofstream &file, const std::string &path) {
+    file.open(path);
+    if (!file)
+      throw std::runtime_error("failed to write " + path);
+  }
+}
+
+void Tables::writeFreqTable(std::ostream &out) {
+  out << "// Frequency to pitch lookup table, generated from HPS/Tables.h.\n"
+    "// This can be inferred as ROM.\n"
+    "// Author: Yibo Cao\n"
+    "\n"
+    "module freq_table (\n"
+    "\tinput clk,\n"
+    "\tinput [5:0] pitch,\n"
+    "\toutput logic [23:0] freq\n"
+    ");\n"
+    "\talways_ff @(posedge clk) case (pitch)\n";
+  for (uint8_t i = 0; i < FREQS; ++i)
+    out << "\t\t" << +i << ": freq <= " << Freqs::values[i] << ";\n";
+  out << "\t\tdefault: freq <= 24'bX;\n"
+    "\tendcase\n"
+    "endmodule\n";
+}
+
+void Tables::writeCoefs(std::ostream &out) {
+  out << "// Coefficients of filters with fixed parameters, generated from\n"
+    "// HPS/Tables.h. Each set is what the filter would compute from its\n"
+    "// cutoff and resonance with the shared multiplier and divider.\n"
+    "\n"
+    "package coefs;\n"
+    "\t// lowpass_2 of square_delay: cutoff 425 Hz, resonance 0.5.\n";
+  writeHex64(out, "SQUARE_DELAY_LPF_C1", SQUARE_DELAY_LPF.c1);
+  writeHex64(out, "SQUARE_DELAY_LPF_C2", SQUARE_DELAY_LPF.c2);
+  writeHex64(out, "SQUARE_DELAY_LPF_C3", SQUARE_DELAY_LPF.c3);
+  out << "endpackage\n";
+}
+
+void Tables::generate(const std::string &dir) {
+  std::ofstream file;
+  open(file, dir + "/freq_table.sv");
+  writeFreqTable(file);
+  file.close();
+  open(file, dir + "/dsp/coefs.sv");
+  writeCoefs(file);
+}
@@ -0,0 +1,81 @@
+#ifndef _TABLES_H_
+#define _TABLES_H_
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "Layout.h"
+
+// Tables: constants of the synthesizers computed at compile time, for
+//   host-side models and for the FPGA sources generated from them with
+//   run -g <FPGA directory>:
+//   - The phase increment of each pitch, as in freq_table.sv.
+//   - The coefficients of lowpass_2 at a fixed cutoff, computed exactly
+//     as the filter would, so that it can skip the shared divider.
+
+namespace Tables {
+  // Phase increment of a pitch in equal temperament, where pitch 9 is
+  // A4 at 440 * 128.
+  constexpr double SEMITONE = 1.05946309435929526456;
+  constexpr double semitones(int n) {
+    return n == 0 ? 1.0 : n > 0 ? semitones(n - 1) * SEMITONE : semitones(n + 1) / SEMITONE;
+  }
+  constexpr uint32_t freq(uint8_t pitch) {
+    return static_cast<uint32_t>(440.0 * 128 * semitones(pitch - 9) + 0.5);
+  }
+
+  // All tonal pitches as an array.
+  constexpr uint8_t FREQS = Layout::DRUM_KEY;
+  template <uint8_t... I> struct FreqArray {
+    static constexpr uint32_t values[sizeof...(I)] = {freq(I)...};
+  };
+  template <uint8_t... I> constexpr uint32_t FreqArray<I...>::values[sizeof...(I)];
+  template <uint8_t N, uint8_t... I> struct MakeFreqArray : MakeFreqArray<N - 1, N - 1, I...> {};
+  template <uint8_t... I> struct MakeFreqArray<0, I...> { typedef FreqArray<I...> type; };
+  typedef MakeFreqArray<FREQS>::type Freqs;
+
+  // Products and bit ranges of the shared multiplier, which is signed.
+  constexpr uint64_t mult(uint32_t a, uint32_t b) {
+    return static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(a))
+      * static_cast<int32_t>(b));
+  }
+  constexpr uint32_t bits(uint64_t x, uint8_t hi, uint8_t lo) {
+    return static_cast<uint32_t>((x >> lo) & ((1ull << (hi - lo + 1)) - 1));
+  }
+
+  // Intermediate values and the biquad coefficients of lowpass_2, with
+  // cutoff (-8) and resonance (-16) as its inputs.
+  struct Lowpass2 {
+    uint32_t radian, square, termV, invScale;
+    uint64_t c1, c2, c3;
+  };
+  constexpr Lowpass2 lowpass2Coefs(uint32_t radian, uint32_t square,
+      uint32_t termV, uint32_t invScale) {
+    return Lowpass2{radian, square, termV, invScale,
+      mult(invScale, square),
+      mult(invScale, square - 576000000),
+      mult(invScale, square + 576000000 - termV)};
+  }
+  constexpr Lowpass2 lowpass2Scale(uint32_t radian, uint32_t square, uint32_t termV) {
+    return lowpass2Coefs(radian, square, termV,
+      static_cast<uint32_t>(0xFFFFFFFFFFFFull / (576000000ull + termV + square)));
+  }
+  constexpr Lowpass2 lowpass2Radian(uint32_t radian, uint32_t resonance) {
+    return lowpass2Scale(radian, bits(mult(radian, radian), 51, 20), static_cast<uint32_t>(
+      (static_cast<uint64_t>(bits(mult(radian, 48000 * 2), 43, 12)) << 16) / resonance));
+  }
+  constexpr Lowpass2 lowpass2(uint32_t cutoff, uint32_t resonance) {
+    return lowpass2Radian(bits(mult(cutoff, 1686629713), 59, 28), resonance);
+  }
+
+  // Filters with fixed parameters, named by the instrument using them.
+  constexpr Lowpass2 SQUARE_DELAY_LPF = lowpass2(425 * 256, 32768);
+
+  // Writes freq_table.sv.
+  void writeFreqTable(std::ostream &out);
+  // Writes dsp/coefs.sv, a package with the coefficients of the filters.
+  void writeCoefs(std::ostream &out);
+  // Writes both into an FPGA directory.
+  void generate(const std::string &dir);
+}
+
+#endif
@@ -0,0 +1,33 @@
+#include <algorithm>
+#include "TempoMap.h"
+
+TempoMap::TempoMap() {
+  assign(std::vector<TempoChange>());
+}
+
+void TempoMap::assign(const std::vector<TempoChange> &changes) {
+  segments.clear();
+  if (changes.empty() || changes.front().step)
+    segments.push_back(Segment{0, SAMPLES_PER_16TH << TEMPO_FRAC_BITS, 0, 0});
+  for (const TempoChange &i : changes)
+    segments.push_back(Segment{i.step, i.length, 0, 0});
+
+  for (size_t i = 0; i < segments.size(); ++i) {
+    Segment &segment = segments[i];
+    if (i) {
+      const Segment &prev = segments[i - 1];
+      segment.start = prev.start + static_cast<uint64_t>(segment.step - prev.step) * prev.length;
+    }
+    // Rounded up, so that the scroll is exact at whole subtiles of the
+    // default tempo. The error is too small to reach the next subtile.
+    uint64_t numerator = static_cast<uint64_t>(15) << (32 + TEMPO_FRAC_BITS);
+    segment.scrollScale = (numerator + segment.length - 1) / segment.length;
+  }
+}
+
+const TempoMap::Segment &TempoMap::find(uint32_t step) const {
+  // Songs have few tempo changes, so this is usually the first segment.
+  auto i = std::upper_bound(segments.begin() + 1, segments.end(), step,
+    [](uint32_t x, const Segment &y) { return x < y.step; });
+  return *(i - 1);
+}
@@ -0,0 +1,46 @@
+#ifndef _TEMPO_MAP_H_
+#define _TEMPO_MAP_H_
+#include <cstdint>
+#include <vector>
+
+// TempoMap: length of each step, changing at step positions. Lengths
+//   are in samples with TEMPO_FRAC_BITS fraction bits. The start of
+//   each segment of constant tempo is precomputed as a cumulative sum,
+//   so that the start of any step is a lookup and a multiply. Divisions
+//   only happen when the map is built.
+
+// Default length of a step.
+#define SAMPLES_PER_16TH 4800
+#define TEMPO_FRAC_BITS  8
+
+// Steps from a step on take a length.
+struct TempoChange {
+  uint32_t step, length;
+  bool operator==(const TempoChange &x) const { return step == x.step && length == x.length; }
+};
+
+class TempoMap {
+  struct Segment {
+    uint32_t step, length;
+    // Start of the first step with TEMPO_FRAC_BITS fraction bits.
+    uint64_t start;
+    // Subtile scroll for each sample into a step, with 32 fraction bits.
+    uint64_t scrollScale;
+  };
+  std::vector<Segment> segments;
+  const Segment &find(uint32_t step) const;
+public:
+  TempoMap();
+  // Changes must be sorted by step. Steps before the first change take
+  // the default length.
+  void assign(const std::vector<TempoChange> &changes);
+  void swap(TempoMap &x) { segments.swap(x.segments); }
+  // Start of a step from the start of step 0.
+  uint64_t boundary(uint32_t step) const {
+    const Segment &i = find(step);
+    return i.start + static_cast<uint64_t>(step - i.step) * i.length;
+  }
+  uint64_t scrollScale(uint32_t step) const { return find(step).scrollScale; }
+};
+
+#endif
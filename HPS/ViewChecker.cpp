@@ -0,0 +1,265 @@
+#ifdef H2F_SIM
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include "Setlist.h"
+#include "ViewChecker.h"
+
+ViewChecker::ViewChecker(uint32_t seed)
+    :main(), sequencer(main.sequencer), rng(seed), stepNo(0),
+    play(false), record(false), keyStates(0), keysKnown(true), keysFrom(0),
+    expected(), previous(), incrementalWrites(0), changedTiles(0), changedSteps(0), predictedSteps(0) {
+  sequencer.flushTiles();
+  incrementalWrites = main.h2f.getSimTileWrites();
+}
+
+uint32_t ViewChecker::random(uint32_t lo, uint32_t hi) {
+  return std::uniform_int_distribution<uint32_t>(lo, hi)(rng);
+}
+
+void ViewChecker::addRandomNote() {
+  uint32_t pos = sequencer.tilePos;
+  Note params;
+  params.startTime = random(pos < 20 ? 0 : pos - 20, pos + 80);
+  params.duration = random(0, 3) ? random(1, 8) : random(1, 100);
+  params.pitch = random(0, Layout::KEYS - 1);
+  params.inst = random(0, Layout::INSTS - 1);
+
+  // Overlapping notes of the same key and instrument are ambiguous.
+  for (const Note &i : sequencer.notes)
+    if (i.pitch == params.pitch && i.inst == params.inst
+        && i.startTime <= params.endTime() && params.startTime <= i.endTime())
+      return;
+  SongDiff diff;
+  diff.added.push_back(params);
+  sequencer.applyDiff(diff);
+  addedAt[&sequencer.notes.front()] = pos;
+}
+
+void ViewChecker::removeRandomNote() {
+  if (sequencer.notes.empty()) return;
+  auto i = sequencer.notes.begin();
+  std::advance(i, random(0, sequencer.notes.size() - 1));
+  const Note *note = &*i;
+  SongDiff diff;
+  diff.removed.push_back(*i);
+  sequencer.applyDiff(diff);
+  addedAt.erase(note);
+}
+
+void ViewChecker::swapRandomSong() {
+  SongFile song;
+  for (uint32_t i = random(0, 80); i--; ) {
+    Note params;
+    params.startTime = random(0, 150);
+    params.duration = random(0, 3) ? random(1, 8) : random(1, 100);
+    params.pitch = random(0, Layout::KEYS - 1);
+    params.inst = random(0, Layout::INSTS - 1);
+    bool overlaps = false;
+    for (const Note &j : song.notes)
+      overlaps |= j.pitch == params.pitch && j.inst == params.inst
+        && j.startTime <= params.endTime() && params.startTime <= j.endTime();
+    if (!overlaps) song.notes.push_back(params);
+  }
+  if (random(0, 1)) {
+    song.loopStart = random(0, 100);
+    song.loopEnd = song.loopStart + random(1, 60);
+  }
+  if (random(0, 1)) {
+    // From the shortest step of a song file to over twice the default,
+    // or now and then to the longest.
+    std::set<uint32_t> steps;
+    for (uint32_t i = random(1, 4); i--; )
+      steps.insert(random(0, 150));
+    for (uint32_t i : steps) {
+      uint32_t samples = random(0, 15) ? random(16, 2 * SAMPLES_PER_16TH) : 1 << 20;
+      song.tempo.push_back(TempoChange{i, (samples << TEMPO_FRAC_BITS) + random(0, 255)});
+    }
+  }
+  LoadedSong loaded;
+  loaded.assign(song);
+  sequencer.swapSong(loaded);
+  resetKeys(0);
+}
+
+void ViewChecker::resetKeys(uint32_t from) {
+  keysKnown = !record;
+  keysFrom = from;
+  addedAt.clear();
+}
+
+void ViewChecker::render() {
+  uint32_t pos = sequencer.tilePos;
+  uint32_t bottom = pos < Layout::ROWS_BELOW ? 0 : pos - Layout::ROWS_BELOW;
+  uint32_t top = pos + Layout::ROWS_ABOVE;
+  std::fill(expected, expected + Layout::TILES, 0);
+  for (const Note &i : sequencer.notes) {
+    uint32_t start = std::max(i.startTime, bottom);
+    uint32_t end = std::min(i.endTime(), top);
+    for (uint32_t j = start; j <= end; ++j) {
+      uint8_t row = j + Layout::ROWS_BELOW - pos + sequencer.tileOffset;
+      TileState state = 1 | (j == i.startTime) << 1 | (j == i.endTime()) << 2;
+      expected[Layout::tileAddr(row, i.pitch)] |= state << (i.inst * Layout::TILE_BITS);
+    }
+  }
+
+  // A renderer writing only the changed tiles.
+  uint32_t changed = 0;
+  for (uint16_t i = 0; i < Layout::TILES; ++i)
+    changed += expected[i] != previous[i];
+  changedTiles += changed;
+  changedSteps += changed != 0;
+  std::copy(expected, expected + Layout::TILES, previous);
+}
+
+bool ViewChecker::check(std::ostream &out) {
+  auto fail = [&](const char *what) -> std::ostream& {
+    out << "step " << stepNo << " (tilePos " << sequencer.tilePos << ", tileOffset "
+      << static_cast<int>(sequencer.tileOffset) << "): " << what;
+    return out;
+  };
+
+  for (uint16_t i = 0; i < Layout::TILES; ++i) {
+    uint8_t row = i / Layout::KEYS, pitch = i % Layout::KEYS;
+    if (sequencer.tileStates[i] != expected[i]) {
+      fail("tile") << " row " << +row << " pitch " << +pitch << " is "
+        << std::oct << sequencer.tileStates[i] << ", expected " << expected[i]
+        << std::dec << std::endl;
+      return false;
+    }
+    if (main.h2f.getSimTile(i) != expected[i]) {
+      fail("written tile") << " row " << +row << " pitch " << +pitch << " is "
+        << std::oct << main.h2f.getSimTile(i) << ", expected " << expected[i]
+        << std::dec << std::endl;
+      return false;
+    }
+  }
+
+  uint32_t pos = sequencer.tilePos, visible = 0;
+  for (const Note &i : sequencer.notes) {
+    bool isVisible = i.startTime <= pos + Layout::ROWS_ABOVE && (pos < Layout::ROWS_BELOW
+      || i.endTime() >= pos - Layout::ROWS_BELOW);
+    visible += isVisible;
+    if (i.isInView != isVisible) {
+      fail(isVisible ? "note missing from view" : "note left in view")
+        << ": " << i.startTime << "+" << i.duration << std::endl;
+      return false;
+    }
+  }
+  if (sequencer.view.size() != visible) {
+    fail("view size") << " is " << sequencer.view.size()
+      << ", expected " << visible << std::endl;
+    return false;
+  }
+
+  InstMask keys[Layout::KEYS] = {};
+  if (sequencer.isPlaying) {
+    if (!keysKnown) return true;
+    for (const Note &i : sequencer.notes) {
+      auto added = addedAt.find(&i);
+      uint32_t from = added == addedAt.end() ? keysFrom : added->second;
+      if (i.startTime <= pos && i.endTime() >= pos && i.startTime >= from)
+        keys[i.pitch] |= 1 << i.inst;
+    }
+  }
+  for (uint8_t i = 0; i < Layout::KEYS; ++i) {
+    if (main.keyboard.sequencer[i] != keys[i]) {
+      fail("sequencer keys") << " of pitch " << static_cast<int>(i) << " are "
+        << static_cast<int>(main.keyboard.sequencer[i]) << ", expected "
+        << static_cast<int>(keys[i]) << std::endl;
+      return false;
+    }
+    if (main.h2f.getSimKeyState(i) != keys[i]) {
+      fail("written keys") << " of pitch " << static_cast<int>(i) << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ViewChecker::run(uint32_t steps, std::ostream &out) {
+  for (stepNo = 0; stepNo < steps; ++stepNo) {
+    bool wasPlaying = sequencer.isPlaying;
+    uint32_t r = random(0, 99);
+    if (r < 25) {
+      addRandomNote();
+    } else if (r < 35) {
+      removeRandomNote();
+    } else if (r < 47) {
+      if (!sequencer.shouldLockView()) {
+        bool positive = random(0, 2) != 0;
+        uint32_t pos = sequencer.tilePos;
+        sequencer.scroll(positive);
+        if (wasPlaying && !positive && sequencer.tilePos != pos)
+          resetKeys(sequencer.tilePos + 1);
+      }
+    } else if (r < 50) {
+      sequencer.seek(random(0, 200));
+      if (wasPlaying) resetKeys(sequencer.tilePos);
+    } else if (r < 53) {
+      uint32_t start = random(0, 150);
+      if (random(0, 2)) sequencer.setLoop(start, start + random(1, 60));
+      else sequencer.setLoop(0, 0);
+    } else if (r < 57) {
+      play = !play;
+    } else if (r < 61) {
+      record = !record;
+    } else if (r < 66) {
+      keyStates = random(0, 4095);
+    } else if (r < 67) {
+      swapRandomSong();
+    } else {
+      main.timeBase += random(1, 2 * sequencer.getStepLength());
+    }
+
+    // Boundaries crossed by the update, timed as Sequencer::timeStep.
+    uint32_t pos = sequencer.tilePos;
+    uint32_t boundaries = 0;
+    uint32_t elapsed = main.timeBase - sequencer.lastBoundary;
+    for (uint32_t length = sequencer.getStepLength(); elapsed >= length; ) {
+      elapsed -= length;
+      ++boundaries;
+      length = ((sequencer.tempoOrigin + sequencer.tempo.boundary(pos + boundaries + 1)) >> TEMPO_FRAC_BITS)
+        - ((sequencer.tempoOrigin + sequencer.tempo.boundary(pos + boundaries)) >> TEMPO_FRAC_BITS);
+    }
+    uint64_t writesBefore = main.h2f.getSimWrites();
+    sequencer.update(play, record, keyStates);
+    if (play && !wasPlaying)
+      resetKeys(pos);
+    else if (play && sequencer.tilePos != pos + boundaries)
+      resetKeys(0); // Wrapped around the loop.
+    if (play && record)
+      keysKnown = false;
+    sequencer.flushTiles();
+
+    // Only time passed, across one boundary of playback. The update
+    // also writes the subtile scroll.
+    if (r >= 67 && play && wasPlaying && !record && boundaries == 1
+        && sequencer.tilePos == pos + 1) {
+      SongAnalysis analysis;
+      sequencer.analyze(analysis);
+      uint32_t predicted = analysis.writesAt(sequencer.tilePos);
+      uint64_t measured = main.h2f.getSimWrites() - writesBefore - 1;
+      if (measured != predicted) {
+        out << "step " << stepNo << ": " << measured << " bridge writes into step "
+          << sequencer.tilePos << ", " << predicted << " predicted" << std::endl;
+        return false;
+      }
+      ++predictedSteps;
+    }
+
+    render();
+    if (!check(out)) return false;
+  }
+
+  uint64_t writes = main.h2f.getSimTileWrites() - incrementalWrites;
+  out << steps << " steps passed, " << sequencer.notes.size() << " notes at the end, "
+    << predictedSteps << " boundaries as predicted by the analysis" << std::endl;
+  out << "tile writes: " << writes << " incremental, " << changedTiles
+    << " changed tiles (" << static_cast<double>(writes) / changedTiles << "x), "
+    << changedSteps * Layout::TILES << " for full redraws ("
+    << static_cast<double>(writes) / (changedSteps * Layout::TILES) << "x)" << std::endl;
+  return true;
+}
+
+#endif
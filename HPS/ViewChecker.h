@@ -0,0 +1,55 @@
+#ifndef _VIEW_CHECKER_H_
+#define _VIEW_CHECKER_H_
+#ifdef H2F_SIM
+#include <map>
+#include <ostream>
+#include <random>
+#include "Main.h"
+
+// ViewChecker: randomized differential test of the incremental view
+//   maintenance in Sequencer. Random edits, scrolls, seeks, song swaps,
+//   playback and recording are applied through the public interfaces,
+//   and after each step the tiles, the tiles written to the simulated
+//   bridge, the notes in view and the sequencer key states are compared
+//   with a render from scratch. Also counts the tile writes against what a
+//   renderer writing only the changed tiles would need, and checks the
+//   bridge writes at each boundary of plain playback against the
+//   prediction of SongAnalysis.
+//   Run with run_sim -t <steps> [seed].
+
+class ViewChecker {
+  Main main;
+  Sequencer &sequencer;
+  std::mt19937 rng;
+  uint32_t stepNo;
+
+  // Inputs of Sequencer::update.
+  bool play, record;
+  uint16_t keyStates;
+
+  // The sequencer key states are only predictable from the notes when
+  // not recording. Notes starting from keysFrom are played, or for notes
+  // added since, starting from where they were added.
+  bool keysKnown;
+  uint32_t keysFrom;
+  std::map<const Note*, uint32_t> addedAt;
+
+  // Reference render and bridge write statistics.
+  TileState expected[Layout::TILES], previous[Layout::TILES];
+  uint64_t incrementalWrites, changedTiles, changedSteps, predictedSteps;
+
+  uint32_t random(uint32_t lo, uint32_t hi);
+  void addRandomNote();
+  void removeRandomNote();
+  void swapRandomSong();
+  void resetKeys(uint32_t from);
+  void render();
+  bool check(std::ostream &out);
+public:
+  explicit ViewChecker(uint32_t seed);
+  // Returns false at the first mismatch, after printing it.
+  bool run(uint32_t steps, std::ostream &out);
+};
+
+#endif
+#endif
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include "VoiceEngine.h"
+
+namespace {
+  const uint32_t MASK = 0xFFFFFF;
+  // Constants of super_saw_voices.sv.
+  const uint32_t PHASE_INIT[7] = {11237, 9182, 28532, 13285, 18604, 33356, 321};
+  const uint32_t DETUNING[7] = {64596, 64896, 65347, 65536, 65764, 66221, 66451};
+  const uint32_t MIXING[7] = {199729, 249661, 349525, 499322, 349525, 249661, 199729};
+  const uint32_t PHASE_PERIOD = 48000 * 256;
+  // Parameters of delay.sv.
+  const uint32_t ECHO_LENGTH = 4800 * 2;
+  const int64_t ECHO_FEEDBACK = 128;
+
+  // saw.sv.
+  uint32_t saw(uint16_t x) {
+    bool shifted = x >= 24000;
+    uint64_t p = static_cast<uint64_t>(shifted ? x - 24000 : x) * 178956;
+    uint32_t y = p >> 9 & MASK;
+    return shifted ? (y - 8388608) & MASK : y;
+  }
+}
+
+VoiceEngine::VoiceEngine(uint8_t count) :voices(count), events(0) {
+  for (Voice &i : voices) {
+    i.pitch = 0;
+    i.freq = 0;
+    i.gate = i.trigger = false;
+    i.stamp = 0;
+    i.amp = 0;
+    for (uint8_t j = 0; j < 7; ++j)
+      i.phase[j] = PHASE_INIT[j];
+  }
+}
+
+uint8_t VoiceEngine::press(uint8_t pitch, uint32_t freq) {
+  uint8_t which = 0;
+  int32_t best = -1;
+  for (uint8_t i = 0; i < voices.size(); ++i) {
+    int32_t key = !voices[i].gate << 16 | static_cast<uint16_t>(events - voices[i].stamp);
+    if (key > best) {
+      best = key;
+      which = i;
+    }
+  }
+  Voice &voice = voices[which];
+  voice.pitch = pitch;
+  voice.freq = freq & MASK;
+  voice.gate = voice.trigger = true;
+  voice.stamp = events++;
+  return which;
+}
+
+void VoiceEngine::release(uint8_t pitch) {
+  for (Voice &i : voices) {
+    if (i.gate && i.pitch == pitch) {
+      i.gate = false;
+      i.stamp = events;
+    }
+  }
+  ++events;
+}
+
+uint32_t VoiceEngine::sample() {
+  uint32_t out = 0;
+  for (Voice &voice : voices) {
+    uint32_t &amp = voice.amp;
+    if (voice.trigger)
+      amp = MASK;
+    else if (voice.gate)
+      amp = (amp - (((amp - 8388608) & MASK) >> 11)) & MASK;
+    else
+      amp = (amp - (amp >> 12)) & MASK;
+    voice.trigger = false;
+
+    uint32_t wave = 0;
+    for (uint8_t i = 0; i < 7; ++i) {
+      uint32_t step = static_cast<uint64_t>(voice.freq) * DETUNING[i] >> 16 & MASK;
+      uint32_t next = voice.phase[i] + step;
+      if (next > PHASE_PERIOD)
+        next -= PHASE_PERIOD;
+      voice.phase[i] = next & MASK;
+    }
+    for (uint8_t i = 0; i < 7; ++i) {
+      uint64_t mixed = static_cast<uint64_t>(saw(voice.phase[i] >> 8)) * MIXING[i];
+      wave = (wave + (mixed >> 24 & MASK)) & MASK;
+    }
+    out += static_cast<uint64_t>(wave) * amp >> 24 & MASK;
+  }
+  out = std::min<uint32_t>(out, 0x7FFFFF);
+
+  // The echo only starts once the FIFO holds a full delay.
+  if (echo.size() == ECHO_LENGTH) {
+    int32_t past = static_cast<int32_t>(echo.front() << 8) >> 8;
+    out = (out + (ECHO_FEEDBACK * past >> 8)) & MASK;
+    echo.pop_front();
+  }
+  echo.push_back(out);
+  return out;
+}
+
+#ifdef VOICE_ENGINE_DPI
+
+// DPI-C functions used by super_saw_voices_testbench.
+static VoiceEngine dpiEngine;
+
+extern "C" void voice_engine_reset(int voices) {
+  dpiEngine = VoiceEngine(voices);
+}
+
+extern "C" int voice_engine_press(int pitch, int freq) {
+  return dpiEngine.press(pitch, freq);
+}
+
+extern "C" void voice_engine_release(int pitch) {
+  dpiEngine.release(pitch);
+}
+
+extern "C" int voice_engine_sample() {
+  return dpiEngine.sample();
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _VOICE_ENGINE_H_
+#define _VOICE_ENGINE_H_
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// VoiceEngine: reference model of super_saw_voices.sv, bit for bit.
+//   Voices are allocated and stolen like in the hardware, and a sample
+//   runs the 7 detuned sawtooths of each voice in turn.
+//   Events between two samples take effect at the next sample.
+//   The mix of the voices saturates at the largest positive value, and
+//   then goes through the echo of delay.sv.
+
+// Voices of super_saw_voices, as synthesizers.sv would use it.
+#define SUPER_SAW_VOICES 8
+
+class VoiceEngine {
+public:
+  struct Voice {
+    uint8_t pitch;
+    uint32_t freq;
+    bool gate, trigger;
+    // Event count at the last press or release.
+    uint16_t stamp;
+    uint32_t amp, phase[7];
+  };
+private:
+  std::vector<Voice> voices;
+  uint16_t events;
+  // Outputs of the last samples, as in the FIFO of delay.sv.
+  std::deque<uint32_t> echo;
+public:
+  explicit VoiceEngine(uint8_t voices = SUPER_SAW_VOICES);
+  // Takes a free voice, the one released longest ago, or else steals
+  // the one pressed longest ago. Returns the voice.
+  uint8_t press(uint8_t pitch, uint32_t freq);
+  void release(uint8_t pitch);
+  // Returns wave_out of the next sample.
+  uint32_t sample();
+  const std::vector<Voice> &getVoices() const { return voices; }
+};
+
+#endif